@@ -0,0 +1,510 @@
+#include "Adaptive.h"
+#include "Profile.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+const unsigned int adaptiveGridBits = 20;
+const unsigned int adaptiveGridSize = 1u << adaptiveGridBits;
+
+namespace {
+
+// Backstop for degenerate (collinear) triangles, which the grid alone
+// doesn't obviously bound
+const unsigned int depthLimit = 3 * adaptiveGridBits;
+
+const unsigned int noVertex = 0xffffffffu;
+const unsigned long long emptyKey = ~0ull;
+
+// Children of a split triangle for each set of split edges, as indices into
+// { v1, v2, v3, m1, m2, m3 } where m1 splits v1-v2, m2 v2-v3 and m3 v1-v3.
+// The mask has bit 0 for edge 1, bit 1 for edge 2 and bit 2 for edge 3.
+class SplitCase {
+public:
+	int count;
+	unsigned char children[4][3];
+};
+
+const SplitCase splitCases[8] = {
+	{ 0, { { 0 } } },
+	{ 2, { { 0, 3, 2 }, { 3, 1, 2 } } },							// edge 1
+	{ 2, { { 0, 1, 4 }, { 0, 4, 2 } } },							// edge 2
+	{ 3, { { 0, 3, 4 }, { 3, 1, 4 }, { 0, 4, 2 } } },				// edges 1, 2
+	{ 2, { { 0, 1, 5 }, { 5, 1, 2 } } },							// edge 3
+	{ 3, { { 0, 3, 5 }, { 5, 3, 2 }, { 3, 1, 2 } } },				// edges 1, 3
+	{ 3, { { 0, 1, 5 }, { 1, 4, 5 }, { 5, 4, 2 } } },				// edges 2, 3
+	{ 4, { { 0, 3, 5 }, { 3, 1, 4 }, { 5, 4, 2 }, { 3, 4, 5 } } }	// all
+};
+
+inline float gridParameter(unsigned int i) {
+	return i * (1.0f / adaptiveGridSize);
+}
+
+// Whether the edge from a to b runs along a side of the patch. Such an edge
+// is shared with the neighbour across that side, which must split it alike.
+inline bool onPatchSide(const AdaptiveVertex& a, const AdaptiveVertex& b) {
+	return (a.u == b.u && (a.u == 0 || a.u == adaptiveGridSize))
+		|| (a.v == b.v && (a.v == 0 || a.v == adaptiveGridSize));
+}
+
+// Whether a side edge from a to b may still be split: its halvings from the
+// whole side are below maxSideDepth. This depends on the edge alone, so the
+// neighbour across the side decides alike.
+inline bool sideSplittable(const AdaptiveVertex& a, const AdaptiveVertex& b, unsigned int maxSideDepth) {
+	unsigned int length = (a.u > b.u ? a.u - b.u : b.u - a.u) + (a.v > b.v ? a.v - b.v : b.v - a.v);
+	return maxSideDepth >= adaptiveGridBits || length > (adaptiveGridSize >> maxSideDepth);
+}
+
+inline unsigned long long gridKey(unsigned int u, unsigned int v) {
+	return ((unsigned long long) u << 32) | v;
+}
+
+inline size_t hashKey(unsigned long long key) {
+	key ^= key >> 29;
+	key *= 0xbf58476d1ce4e5b9ull;
+	key ^= key >> 32;
+	return (size_t) key;
+}
+
+unsigned int cornerVertex(AdaptiveScratch& scratch, const BPatch& patch, unsigned int u, unsigned int v,
+	Point p) {
+	AdaptiveVertex vertex;
+	vertex.u = u;
+	vertex.v = v;
+	vertex.p = p;
+	vertex.n = patchPoint(gridParameter(u), gridParameter(v), patch).p2;
+	vertex.meshIndex = noVertex;
+	scratch.vertices.push_back(vertex);
+	return scratch.vertices.size() - 1;
+}
+
+AdaptiveTriangle makeTriangle(unsigned int v1, unsigned int v2, unsigned int v3, unsigned int depth,
+	float error) {
+	AdaptiveTriangle tri;
+	tri.v1 = v1;
+	tri.v2 = v2;
+	tri.v3 = v3;
+	tri.depth = depth;
+	tri.error = error;
+	return tri;
+}
+
+bool lowerError(const AdaptiveTriangle& a, const AdaptiveTriangle& b) {
+	return a.error < b.error;
+}
+
+unsigned int meshVertex(Mesh& mesh, AdaptiveVertex& vertex) {
+	if (vertex.meshIndex == noVertex) {
+		vertex.meshIndex = addVertex(mesh, vertex.p, vertex.n);
+	}
+	return vertex.meshIndex;
+}
+
+// The first vertex is emitted last in each triangle so that it stays the
+// provoking vertex for flat shading, as it was with GL_POLYGON.
+void emitTriangle(AdaptiveScratch& scratch, const AdaptiveTriangle& tri, Mesh& mesh) {
+	unsigned int i1 = meshVertex(mesh, scratch.vertices[tri.v1]);
+	unsigned int i2 = meshVertex(mesh, scratch.vertices[tri.v2]);
+	unsigned int i3 = meshVertex(mesh, scratch.vertices[tri.v3]);
+
+	mesh.indices.push_back(i2);
+	mesh.indices.push_back(i3);
+	mesh.indices.push_back(i1);
+	countEvent(COUNTER_DEPTH + std::min(tri.depth, (unsigned int) profileDepthBins - 1));
+}
+
+}
+
+//****************************************************
+// Midpoint cache
+//****************************************************
+
+void MidpointCache::clear() {
+	if (count > 0) {
+		std::fill(keys.begin(), keys.end(), emptyKey);
+		count = 0;
+	}
+}
+
+const unsigned int* MidpointCache::find(unsigned long long key) const {
+	if (keys.empty()) {
+		return NULL;
+	}
+	size_t mask = keys.size() - 1;
+	for (size_t i = hashKey(key) & mask; ; i = (i + 1) & mask) {
+		if (keys[i] == key) {
+			return &values[i];
+		}
+		if (keys[i] == emptyKey) {
+			return NULL;
+		}
+	}
+}
+
+void MidpointCache::insert(unsigned long long key, unsigned int value) {
+	if ((count + 1) * 2 > keys.size()) {
+		grow();
+	}
+	size_t mask = keys.size() - 1;
+	size_t i = hashKey(key) & mask;
+	while (keys[i] != emptyKey) {
+		i = (i + 1) & mask;
+	}
+	keys[i] = key;
+	values[i] = value;
+	count++;
+}
+
+void MidpointCache::grow() {
+	std::vector<unsigned long long> oldKeys;
+	std::vector<unsigned int> oldValues;
+	oldKeys.swap(keys);
+	oldValues.swap(values);
+
+	keys.assign(oldKeys.empty() ? 256 : oldKeys.size() * 2, emptyKey);
+	values.resize(keys.size());
+	count = 0;
+	for (size_t i = 0; i < oldKeys.size(); i++) {
+		if (oldKeys[i] != emptyKey) {
+			insert(oldKeys[i], oldValues[i]);
+		}
+	}
+}
+
+//****************************************************
+// Subdivision
+//****************************************************
+
+namespace {
+
+const int edges[3][2] = { { 0, 1 }, { 1, 2 }, { 0, 2 } };
+
+inline float dotPoint(Point a, Point b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Sets tolerance and returns the deviation to compare it against for an
+// edge from a to b whose surface midpoint is mid with normal midNormal
+float edgeError(Point a, Point b, Point aNormal, Point bNormal, Point mid, Point midNormal,
+	const AdaptiveView* view, float& tolerance) {
+	Point chord = midPoint(a, b);
+	if (!view) {
+		tolerance = stepSize;
+		return distancePoint(mid, chord);
+	}
+
+	Point d;
+	d.x = mid.x - chord.x;
+	d.y = mid.y - chord.y;
+	d.z = mid.z - chord.z;
+	float sx = dotPoint(d, view->toScreenX);
+	float sy = dotPoint(d, view->toScreenY);
+
+	tolerance = view->pixelError;
+	float fa = dotPoint(aNormal, view->toEye);
+	float fb = dotPoint(bNormal, view->toEye);
+	float fm = dotPoint(midNormal, view->toEye);
+	if ((fa < 0) != (fb < 0) || (fa < 0) != (fm < 0)
+		|| fm * fm < 0.0625f * dotPoint(midNormal, midNormal)) {
+		tolerance /= view->silhouetteScale;
+	}
+	return sqrt(sx * sx + sy * sy);
+}
+
+// Fills slots with { v1, v2, v3, m1, m2, m3 }, the m's being noVertex for
+// edges that don't split, and returns the split mask. Edges seen for the
+// first time are evaluated together, or recorded as unsplit without being
+// evaluated when the triangle is frozen; edges already decided keep their
+// outcome either way, so both sides of an edge always agree. Edges along
+// the patch's sides ignore frozen and answer to sidesFrozen and maxSideDepth
+// instead: their outcome then depends on the boundary curve and on limits
+// every patch shares, so the neighbour's agrees. If error is given it
+// receives the largest deviation among the split edges, in units of their
+// tolerance.
+int testEdges(AdaptiveScratch& scratch, const BPatch& patch, const PatchSoA& soa,
+	const AdaptiveView* view, const AdaptiveTriangle& tri, bool frozen, bool sidesFrozen,
+	unsigned int maxSideDepth, unsigned int slots[6], float* error) {
+	slots[0] = tri.v1;
+	slots[1] = tri.v2;
+	slots[2] = tri.v3;
+
+	unsigned long long keys[3];
+	int pending[3];
+	Point params[3];
+	int pendingCount = 0;
+	for (int e = 0; e < 3; e++) {
+		slots[3 + e] = noVertex;
+		const AdaptiveVertex& a = scratch.vertices[slots[edges[e][0]]];
+		const AdaptiveVertex& b = scratch.vertices[slots[edges[e][1]]];
+		unsigned int su = a.u + b.u, sv = a.v + b.v;
+		bool side = onPatchSide(a, b);
+		if ((su | sv) & 1 || (a.u == b.u && a.v == b.v) || (!side && tri.depth >= depthLimit)) {
+			continue;
+		}
+		keys[e] = gridKey(su / 2, sv / 2);
+		const unsigned int* known = scratch.midpoints.find(keys[e]);
+		if (known) {
+			slots[3 + e] = *known;
+			if (*known != MidpointCache::noSplit && !side) {
+				scratch.openSplits--;
+			}
+		} else if (side ? sidesFrozen || !sideSplittable(a, b, maxSideDepth) : frozen) {
+			scratch.midpoints.insert(keys[e], MidpointCache::noSplit);
+		} else {
+			params[pendingCount].x = gridParameter(su / 2);
+			params[pendingCount].y = gridParameter(sv / 2);
+			params[pendingCount].z = 0.0;
+			pending[pendingCount++] = e;
+		}
+	}
+
+	if (pendingCount > 0) {
+		Tuple mids[3];
+		if (simdEvaluation) {
+			patchPointBatch(soa, params, mids, pendingCount);
+		} else {
+			for (int k = 0; k < pendingCount; k++) {
+				mids[k] = patchPoint(params[k].x, params[k].y, patch);
+			}
+		}
+
+		for (int k = 0; k < pendingCount; k++) {
+			int e = pending[k];
+			const AdaptiveVertex& a = scratch.vertices[slots[edges[e][0]]];
+			const AdaptiveVertex& b = scratch.vertices[slots[edges[e][1]]];
+			unsigned int outcome = MidpointCache::noSplit;
+			float tolerance;
+			if (edgeError(a.p, b.p, a.n, b.n, mids[k].p1, mids[k].p2, view, tolerance) > tolerance) {
+				if (!onPatchSide(a, b)) {
+					scratch.openSplits++;
+				}
+				AdaptiveVertex vertex;
+				vertex.u = (a.u + b.u) / 2;
+				vertex.v = (a.v + b.v) / 2;
+				vertex.p = mids[k].p1;
+				vertex.n = mids[k].p2;
+				vertex.meshIndex = noVertex;
+				scratch.vertices.push_back(vertex);
+				outcome = scratch.vertices.size() - 1;
+			}
+			scratch.midpoints.insert(keys[e], outcome);
+			slots[3 + e] = outcome;
+		}
+	}
+
+	int mask = 0;
+	for (int e = 0; e < 3; e++) {
+		if (slots[3 + e] != noVertex) {
+			mask |= 1 << e;
+			if (error) {
+				const AdaptiveVertex& a = scratch.vertices[slots[edges[e][0]]];
+				const AdaptiveVertex& b = scratch.vertices[slots[edges[e][1]]];
+				const AdaptiveVertex& m = scratch.vertices[slots[3 + e]];
+				float tolerance;
+				float deviation = edgeError(a.p, b.p, a.n, b.n, m.p, m.n, view, tolerance);
+				*error = std::max(*error, deviation / tolerance);
+			}
+		}
+	}
+	return mask;
+}
+
+// Tells whether limits.sideDeadline has passed, looking at the clock every
+// 32 triangles
+class SideClock {
+public:
+	SideClock(const AdaptiveLimits& limits) : deadline(limits.sideDeadline), ticks(0), passed(false) {}
+
+	bool frozen() {
+		if (deadline > 0.0 && !passed && (ticks++ & 31) == 0) {
+			passed = currentTime() >= deadline;
+		}
+		return passed;
+	}
+
+private:
+	double deadline;
+	unsigned int ticks;
+	bool passed;
+};
+
+// Runs the stack depth first; the children of a split are pushed in reverse
+// so they are visited in order. Triangles at frozenDepth or deeper split only
+// along edges that are already split or lie on the patch's sides.
+void depthFirst(AdaptiveScratch& scratch, const BPatch& patch, const PatchSoA& soa,
+	const AdaptiveView* view, Mesh& mesh, const AdaptiveLimits& limits, unsigned int frozenDepth) {
+	SideClock clock(limits);
+	while (!scratch.stack.empty()) {
+		AdaptiveTriangle tri = scratch.stack.back();
+		scratch.stack.pop_back();
+
+		unsigned int slots[6];
+		int mask = testEdges(scratch, patch, soa, view, tri, tri.depth >= frozenDepth, clock.frozen(),
+			limits.maxSideDepth, slots, NULL);
+		if (mask == 0) {
+			emitTriangle(scratch, tri, mesh);
+			continue;
+		}
+
+		const SplitCase& split = splitCases[mask];
+		for (int c = split.count - 1; c >= 0; c--) {
+			const unsigned char* child = split.children[c];
+			scratch.stack.push_back(makeTriangle(slots[child[0]], slots[child[1]], slots[child[2]],
+				tri.depth + 1, 0.0));
+		}
+	}
+}
+
+// Splits the triangle whose parent had the largest error first until a
+// limit is hit, then finishes whatever is still queued frozen. The triangle
+// limit counts the neighbours of the splits so far, which must follow them,
+// so the only overshoot is the refinement of the patch's sides up to their
+// shared limits.
+void bestFirst(AdaptiveScratch& scratch, const BPatch& patch, const PatchSoA& soa,
+	const AdaptiveView* view, Mesh& mesh, const AdaptiveLimits& limits, unsigned int frozenDepth) {
+	std::vector<AdaptiveTriangle>& queue = scratch.queue;
+	queue.clear();
+	while (!scratch.stack.empty()) {
+		queue.push_back(scratch.stack.back());
+		queue.back().error = FLT_MAX;
+		scratch.stack.pop_back();
+	}
+	std::make_heap(queue.begin(), queue.end(), lowerError);
+
+	size_t emitted = 0;
+	unsigned int tested = 0;
+	SideClock clock(limits);
+	double start = limits.deadline > 0.0 ? currentTime() : 0.0;
+	while (!queue.empty()) {
+		// Every queued triangle ends up at least one triangle, and every open
+		// split adds one when its other side follows; a split can add three
+		// triangles and open three more
+		if (limits.maxTriangles
+			&& emitted + queue.size() + scratch.openSplits + 6 > limits.maxTriangles) {
+			break;
+		}
+		if (limits.deadline > 0.0 && (tested & 31) == 0) {
+			// Leave time to finish the queue, at what a triangle has cost so far
+			double now = currentTime();
+			double perTriangle = tested > 0 ? (now - start) / tested : 0.0;
+			if (now + perTriangle * queue.size() >= limits.deadline) {
+				break;
+			}
+		}
+		tested++;
+
+		std::pop_heap(queue.begin(), queue.end(), lowerError);
+		AdaptiveTriangle tri = queue.back();
+		queue.pop_back();
+
+		unsigned int slots[6];
+		float error = 0.0;
+		int mask = testEdges(scratch, patch, soa, view, tri, tri.depth >= frozenDepth, clock.frozen(),
+			limits.maxSideDepth, slots, &error);
+		if (mask == 0) {
+			emitTriangle(scratch, tri, mesh);
+			emitted++;
+			continue;
+		}
+
+		const SplitCase& split = splitCases[mask];
+		for (int c = 0; c < split.count; c++) {
+			const unsigned char* child = split.children[c];
+			queue.push_back(makeTriangle(slots[child[0]], slots[child[1]], slots[child[2]],
+				tri.depth + 1, error));
+			std::push_heap(queue.begin(), queue.end(), lowerError);
+		}
+	}
+
+	scratch.stack.assign(queue.begin(), queue.end());
+	depthFirst(scratch, patch, soa, view, mesh, limits, 0);
+}
+
+}
+
+void adaptiveTraversal(const BPatch& patch, AdaptiveScratch& scratch, Mesh& mesh,
+	const AdaptiveLimits& limits, const AdaptiveView* view) {
+	scratch.vertices.clear();
+	scratch.stack.clear();
+	scratch.midpoints.clear();
+	scratch.openSplits = 0;
+
+	PatchSoA soa;
+	if (simdEvaluation) {
+		patchSoA(patch, soa);
+	}
+
+	const unsigned int one = adaptiveGridSize;
+	unsigned int c00 = cornerVertex(scratch, patch, 0, 0, patch.c1.p1);
+	unsigned int c10 = cornerVertex(scratch, patch, one, 0, patch.c1.p4);
+	unsigned int c01 = cornerVertex(scratch, patch, 0, one, patch.c4.p1);
+	unsigned int c11 = cornerVertex(scratch, patch, one, one, patch.c4.p4);
+	scratch.stack.push_back(makeTriangle(c01, c10, c11, 0, 0.0));
+	scratch.stack.push_back(makeTriangle(c00, c10, c01, 0, 0.0));
+
+	unsigned int frozenDepth = limits.maxDepth ? limits.maxDepth : depthLimit;
+	if (limits.maxTriangles || limits.deadline > 0.0) {
+		bestFirst(scratch, patch, soa, view, mesh, limits, frozenDepth);
+	} else {
+		depthFirst(scratch, patch, soa, view, mesh, limits, frozenDepth);
+	}
+}
+
+float adaptiveSeedError(const BPatch& patch, const AdaptiveView* view) {
+	static const float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+	static const int seedEdges[5][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+
+	Tuple points[4];
+	for (int c = 0; c < 4; c++) {
+		points[c] = patchPoint(corners[c][0], corners[c][1], patch);
+	}
+
+	float error = 0.0;
+	for (int e = 0; e < 5; e++) {
+		int a = seedEdges[e][0], b = seedEdges[e][1];
+		float u = (corners[a][0] + corners[b][0]) / 2;
+		float v = (corners[a][1] + corners[b][1]) / 2;
+		Tuple mid = patchPoint(u, v, patch);
+		float tolerance;
+		float deviation = edgeError(points[a].p1, points[b].p1, points[a].p2, points[b].p2,
+			mid.p1, mid.p2, view, tolerance);
+		error = std::max(error, deviation / tolerance);
+	}
+	return error;
+}
+
+//****************************************************
+// Views
+//****************************************************
+
+void AdaptiveView::orthographic(float scale, float xRot, float yRot, float maxX, float maxY,
+	int width, int height) {
+	const float degrees = 3.14159265f / 180.0f;
+	float cx = cos(xRot * degrees), sx = sin(xRot * degrees);
+	float cy = cos(yRot * degrees), sy = sin(yRot * degrees);
+
+	// Rows of Rx * Ry, which takes model directions to eye space
+	float pixelsX = fabs(scale) * width / (2.0f * maxX);
+	float pixelsY = fabs(scale) * height / (2.0f * maxY);
+	toScreenX.x = cy * pixelsX;
+	toScreenX.y = 0.0;
+	toScreenX.z = sy * pixelsX;
+	toScreenY.x = sx * sy * pixelsY;
+	toScreenY.y = cx * pixelsY;
+	toScreenY.z = -sx * cy * pixelsY;
+	toEye.x = -cx * sy;
+	toEye.y = sx;
+	toEye.z = cx * cy;
+}
+
+bool AdaptiveView::operator==(const AdaptiveView& other) const {
+	const Point* mine[3] = { &toScreenX, &toScreenY, &toEye };
+	const Point* theirs[3] = { &other.toScreenX, &other.toScreenY, &other.toEye };
+	for (int i = 0; i < 3; i++) {
+		if (mine[i]->x != theirs[i]->x || mine[i]->y != theirs[i]->y || mine[i]->z != theirs[i]->z) {
+			return false;
+		}
+	}
+	return pixelError == other.pixelError && silhouetteScale == other.silhouetteScale;
+}
@@ -0,0 +1,144 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <vector>
+
+#include "Bezier.h"
+
+//****************************************************
+// Adaptive tessellation
+//
+// Each patch starts as two triangles in parameter space. A triangle edge is
+// split when the surface point at its parametric midpoint is more than
+// stepSize away from the midpoint of its chord (or, given an AdaptiveView,
+// more than its pixel error away on screen); triangles with no split edges
+// are emitted.
+//
+// Parameters are integers on a dyadic grid of adaptiveGridSize steps per
+// unit, so the midpoint of an edge is exact and identifies the edge. Each
+// midpoint is evaluated and tested once, and its split decision is cached,
+// so the triangles on both sides of an edge always agree and the patch mesh
+// has no T-junctions.
+//****************************************************
+
+// Grid steps per unit of u and v. An edge whose midpoint falls between grid
+// points is never split: this bounds the subdivision even where the
+// midpoint test never passes (slivers on flat patches).
+extern const unsigned int adaptiveGridBits;
+extern const unsigned int adaptiveGridSize;
+
+// A vertex of the subdivision: its grid parameters, the surface point and
+// normal there, and its index in the output mesh once emitted
+class AdaptiveVertex {
+public:
+	unsigned int u, v;
+	Point p, n;
+	unsigned int meshIndex;
+};
+
+// A triangle waiting to be tested, as three vertices of the scratch arena.
+// error is the deviation that split its parent, its priority under a budget.
+class AdaptiveTriangle {
+public:
+	unsigned int v1, v2, v3;
+	unsigned int depth;
+	float error;
+};
+
+// Bounds on one patch's refinement; zero (adaptiveGridBits for
+// maxSideDepth) means unbounded. Once a bound is hit, interior edges not
+// tested yet are kept whole, while edges already split are still split on
+// both sides. Edges along the patch's sides answer only to maxSideDepth and
+// sideDeadline, which must be the same for every patch, so neighbours split
+// their shared sides alike and the mesh stays crack-free. The exception is
+// a side that the pass deadline cuts short: patches reached after it keep
+// whole a side that an earlier neighbour split. A patch can go over
+// maxTriangles or maxDepth by its sides' share, which maxSideDepth bounds.
+class AdaptiveLimits {
+public:
+	unsigned int maxDepth;		// splits from a seed triangle
+	size_t maxTriangles;		// refinement runs largest error first when set
+	double deadline;			// currentTime() to stop refining at; likewise
+	unsigned int maxSideDepth;	// halvings of a whole side of the patch
+	double sideDeadline;		// currentTime() to stop splitting sides at
+
+	AdaptiveLimits() : maxDepth(0), maxTriangles(0), deadline(0.0), maxSideDepth(adaptiveGridBits),
+		sideDeadline(0.0) {}
+};
+
+// Screen-space error for an orthographic view: a world-space offset d
+// covers (d . toScreenX, d . toScreenY) pixels, and n . toEye is positive
+// where a normal faces the viewer. Edges that cross or graze a silhouette
+// are held to pixelError / silhouetteScale, since that is where the outline
+// and the shading show coarse triangles most.
+class AdaptiveView {
+public:
+	Point toScreenX, toScreenY, toEye;
+	float pixelError;
+	float silhouetteScale;
+
+	AdaptiveView() : pixelError(1.0), silhouetteScale(4.0) {
+		toScreenX.x = 1.0; toScreenX.y = 0.0; toScreenX.z = 0.0;
+		toScreenY.x = 0.0; toScreenY.y = 1.0; toScreenY.z = 0.0;
+		toEye.x = 0.0; toEye.y = 0.0; toEye.z = 1.0;
+	}
+
+	// Sets the view of glOrtho(-maxX, maxX, -maxY, maxY) on a width x height
+	// viewport, looking down -z at the model scaled by scale and rotated by
+	// xRot degrees about x after yRot degrees about y, as myDisplay() does
+	void orthographic(float scale, float xRot, float yRot, float maxX, float maxY,
+		int width, int height);
+
+	bool operator==(const AdaptiveView& other) const;
+	bool operator!=(const AdaptiveView& other) const { return !(*this == other); }
+};
+
+// Open-addressing hash from a midpoint's grid position to the outcome of
+// its edge: the arena vertex it was split at, or noSplit
+class MidpointCache {
+public:
+	static const unsigned int noSplit = 0xffffffffu;
+
+	MidpointCache() : count(0) {}
+
+	// Empties the cache, keeping its storage
+	void clear();
+	// Returns the slot for key, or NULL if it isn't there
+	const unsigned int* find(unsigned long long key) const;
+	void insert(unsigned long long key, unsigned int value);
+
+private:
+	void grow();
+
+	std::vector<unsigned long long> keys;
+	std::vector<unsigned int> values;
+	size_t count;
+};
+
+// Working storage for adaptiveTraversal(). Keep one per thread and reuse
+// it: once it has grown to the largest patch, tessellating allocates
+// nothing beyond the output mesh.
+class AdaptiveScratch {
+public:
+	std::vector<AdaptiveVertex> vertices;
+	std::vector<AdaptiveTriangle> stack;
+	std::vector<AdaptiveTriangle> queue;	// max-heap on error
+	MidpointCache midpoints;
+	size_t openSplits;		// interior edges split with the other side still whole
+
+	AdaptiveScratch() : openSplits(0) {}
+};
+
+// Appends the adaptive triangulation of patch to mesh as an indexed mesh
+// whose triangles share their vertices. Without a triangle or time limit it
+// runs depth first; with one, the triangle with the largest error is split
+// next, so a budget cut short leaves the error evenly spread.
+// view selects screen-space error instead of stepSize when given.
+void adaptiveTraversal(const BPatch& patch, AdaptiveScratch& scratch, Mesh& mesh,
+	const AdaptiveLimits& limits = AdaptiveLimits(), const AdaptiveView* view = NULL);
+
+// Largest midpoint deviation of the two seed triangles' edges in units of
+// the tolerance, a cheap estimate of how much refinement the patch needs
+float adaptiveSeedError(const BPatch& patch, const AdaptiveView* view = NULL);
+
+#endif
@@ -0,0 +1,374 @@
+#include "Batch.h"
+#include "Bezier.h"
+#include "Tessellator.h"
+#include "Scene.h"
+#include "MeshIO.h"
+#include "Stream.h"
+#include "Culling.h"
+#include "Lod.h"
+#include "Profile.h"
+#include "FrameBudget.h"
+#include "Density.h"
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+void printUsage(const char* program) {
+	std::cerr << "usage: " << program << " <file.bez|file.bzb> <step> [options]\n"
+		<< "       " << program << " <file.bez> --convert <file.bzb>\n"
+		<< "  -a, --adaptive           adaptive triangulation; step is the flatness tolerance\n"
+		<< "  --max-depth <n>          adaptive: split a seed triangle at most n times\n"
+		<< "  --max-triangles <n>      adaptive: triangle budget, spent on the largest errors first\n"
+		<< "  --max-ms <t>             adaptive: time budget in milliseconds, likewise\n"
+		<< "  --pixel-error <px>       adaptive: tolerance in pixels on the view, with tighter\n"
+		<< "                           silhouettes; step is then ignored\n"
+		<< "  --analytic               uniform grids sized per patch from control net bounds so\n"
+		<< "                           every triangle is within step of the surface; shared\n"
+		<< "                           sides take the finer count of their two patches\n"
+		<< "  --cull-backfaces         skip patches facing away from the viewer (the opening\n"
+		<< "                           view when headless; b toggles it in the window)\n"
+		<< "  --target-ms <t>          window or offscreen: adjust the step, tolerance or pixel\n"
+		<< "                           error to draw frames in about t milliseconds\n"
+		<< "  --lod <levels>           window, uniform mode: keep this many levels of detail\n"
+		<< "                           (step, 2*step, ...) and pick one per patch by zoom\n"
+		<< "  -fd, --forward           forward differencing in uniform mode\n"
+		<< "  -simd[=scalar|sse2|avx2] batched SIMD patch evaluator\n"
+		<< "  -t, --threads <n>        tessellation threads (default: one per core)\n"
+		<< "  -o, --output <file>      write the mesh as binary .ply or .obj (implies --headless)\n"
+		<< "  -c, --convert <file.bzb> write the scene as a binary scene (implies --headless)\n"
+		<< "  --stream                 parse, tessellate and write -o in overlapped blocks,\n"
+		<< "                           keeping memory bounded for huge .bez files\n"
+		<< "  --offscreen <frames>     render frames without a display (EGL) while turning the\n"
+		<< "                           model once about y, and print per-frame timings\n"
+		<< "  --ppm <file>             with --offscreen, write the last frame as a PPM image\n"
+		<< "  --size <w>x<h>           window or offscreen size (default 1000x1000)\n"
+		<< "  --headless               tessellate without a window and print statistics\n"
+		<< "  --profile <file>         write per-frame timings and counters as CSV, or as a\n"
+		<< "                           Chrome trace if file ends in .json (i shows them in\n"
+		<< "                           the window)\n"
+		<< "  -h, --help               show this message" << std::endl;
+}
+
+bool parseCommandLine(int argc, char* argv[], CommandLine& cmd) {
+	std::vector<const char*> positional;
+	const char* adaptiveOption = NULL;		// the last option that only adaptive mode uses
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+			return false;
+		} else if (strcmp(arg, "-a") == 0 || strcmp(arg, "--adaptive") == 0) {
+			adaptive = true;
+		} else if (strcmp(arg, "--max-depth") == 0 || strcmp(arg, "--max-triangles") == 0
+			|| strcmp(arg, "--max-ms") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a value" << std::endl;
+				return false;
+			}
+			adaptiveOption = arg;
+			double value = atof(argv[++i]);
+			if (!(value >= 0.0)) {
+				std::cerr << arg << " must not be negative" << std::endl;
+				return false;
+			}
+			if (strcmp(arg, "--max-depth") == 0) {
+				adaptiveMaxDepth = (unsigned int) value;
+			} else if (strcmp(arg, "--max-triangles") == 0) {
+				adaptiveMaxTriangles = (size_t) value;
+			} else {
+				adaptiveMaxSeconds = value / 1000.0;
+			}
+		} else if (strcmp(arg, "--pixel-error") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a value" << std::endl;
+				return false;
+			}
+			tessellationView.pixelError = atof(argv[++i]);
+			if (!(tessellationView.pixelError > 0.0)) {
+				std::cerr << "Pixel error must be positive" << std::endl;
+				return false;
+			}
+			viewDependent = true;
+			adaptiveOption = arg;
+		} else if (strcmp(arg, "--analytic") == 0) {
+			analyticDensity = true;
+		} else if (strcmp(arg, "--target-ms") == 0) {
+			if (!hasValue || !((targetFrameSeconds = atof(argv[++i]) / 1000.0) > 0.0)) {
+				std::cerr << arg << " needs a positive frame time" << std::endl;
+				return false;
+			}
+		} else if (strcmp(arg, "--lod") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a level count" << std::endl;
+				return false;
+			}
+			lodLevels = atoi(argv[++i]);
+			if (lodLevels < 0 || lodLevels > 16) {
+				std::cerr << "Level count must be between 0 and 16" << std::endl;
+				return false;
+			}
+		} else if (strcmp(arg, "--cull-backfaces") == 0) {
+			cullBackFaces = true;
+		} else if (strcmp(arg, "-fd") == 0 || strcmp(arg, "--forward") == 0) {
+			forwardDifferencing = true;
+		} else if (strncmp(arg, "-simd", 5) == 0 && (arg[5] == '\0' || arg[5] == '=')) {
+			simdEvaluation = true;
+			if (arg[5] == '=') {
+				const char* name = arg + 6;
+				PatchEvaluator requested;
+				if (strcmp(name, "avx2") == 0) {
+					requested = EVALUATOR_AVX2;
+				} else if (strcmp(name, "sse2") == 0) {
+					requested = EVALUATOR_SSE2;
+				} else if (strcmp(name, "scalar") == 0) {
+					requested = EVALUATOR_SCALAR;
+				} else {
+					std::cerr << "Unknown evaluator " << name << std::endl;
+					return false;
+				}
+				if (!setPatchEvaluator(requested)) {
+					std::cerr << name << " evaluator not supported here" << std::endl;
+				}
+			}
+		} else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--threads") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a thread count" << std::endl;
+				return false;
+			}
+			tessellationThreads = atoi(argv[++i]);
+		} else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a file name" << std::endl;
+				return false;
+			}
+			cmd.output = argv[++i];
+			cmd.headless = true;
+		} else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--convert") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a file name" << std::endl;
+				return false;
+			}
+			cmd.convert = argv[++i];
+			cmd.headless = true;
+		} else if (strcmp(arg, "--stream") == 0) {
+			cmd.stream = true;
+			cmd.headless = true;
+		} else if (strcmp(arg, "--offscreen") == 0) {
+			if (!hasValue || (cmd.offscreenFrames = atoi(argv[++i])) <= 0) {
+				std::cerr << arg << " needs a positive frame count" << std::endl;
+				return false;
+			}
+		} else if (strcmp(arg, "--ppm") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a file name" << std::endl;
+				return false;
+			}
+			cmd.ppm = argv[++i];
+		} else if (strcmp(arg, "--size") == 0) {
+			if (!hasValue || sscanf(argv[++i], "%dx%d", &cmd.width, &cmd.height) != 2
+				|| cmd.width <= 0 || cmd.height <= 0) {
+				std::cerr << arg << " needs a size like 800x600" << std::endl;
+				return false;
+			}
+		} else if (strcmp(arg, "--profile") == 0) {
+			if (!hasValue) {
+				std::cerr << arg << " needs a file name" << std::endl;
+				return false;
+			}
+			cmd.profile = argv[++i];
+			profiling = true;
+		} else if (strcmp(arg, "--headless") == 0) {
+			cmd.headless = true;
+		} else if (arg[0] == '-' && arg[1] != '\0') {
+			std::cerr << "Unknown option " << arg << std::endl;
+			return false;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+
+	if (positional.size() == 1 && !cmd.convert.empty() && cmd.output.empty()) {
+		cmd.input = positional[0];
+		cmd.tessellate = false;
+		return true;
+	}
+	if (positional.size() != 2) {
+		std::cerr << "Expected an input file and a step size" << std::endl;
+		return false;
+	}
+	if (cmd.stream && cmd.output.empty()) {
+		std::cerr << "--stream needs an output file" << std::endl;
+		return false;
+	}
+	if (cmd.offscreenFrames > 0 && cmd.headless) {
+		std::cerr << "--offscreen renders, so it can't be combined with headless options" << std::endl;
+		return false;
+	}
+	if (adaptiveOption && !adaptive) {
+		std::cerr << adaptiveOption << " only applies to adaptive triangulation, so it needs -a" << std::endl;
+		return false;
+	}
+	if (analyticDensity && (adaptive || lodLevels > 1 || forwardDifferencing || simdEvaluation)) {
+		std::cerr << "--analytic sizes its own grids, so it can't be combined with adaptive, --lod,"
+			<< " forward differencing or -simd" << std::endl;
+		return false;
+	}
+	if (analyticDensity && cmd.stream) {
+		std::cerr << "--analytic matches patch sides across the whole scene, not --stream" << std::endl;
+		return false;
+	}
+	if (targetFrameSeconds > 0.0 && cmd.headless) {
+		std::cerr << "--target-ms measures drawn frames, so it can't be combined with headless options"
+			<< std::endl;
+		return false;
+	}
+	if (!cmd.ppm.empty() && cmd.offscreenFrames == 0) {
+		std::cerr << "--ppm needs --offscreen" << std::endl;
+		return false;
+	}
+	if (cmd.stream && (viewDependent || cullBackFaces)) {
+		std::cerr << "--pixel-error and --cull-backfaces need the whole scene, not --stream" << std::endl;
+		return false;
+	}
+	cmd.input = positional[0];
+	stepSize = atof(positional[1]);
+	if (!(stepSize > 0.0)) {
+		std::cerr << "Step size must be positive" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+size_t peakMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * (size_t) 1024;
+#endif
+#endif
+}
+
+static int runStream(const CommandLine& cmd) {
+	beginProfileFrame();
+	double start = currentTime();
+	StreamStats stats;
+	if (!streamTessellate(cmd.input, cmd.output, stats)) {
+		return 1;
+	}
+	double finished = currentTime();
+	endProfileFrame();
+	if (!cmd.profile.empty() && !writeProfile(cmd.profile)) {
+		return 1;
+	}
+
+	std::cout << "patches:    " << stats.patches << "\n"
+		<< "vertices:   " << stats.vertices << "\n"
+		<< "triangles:  " << stats.triangles << "\n"
+		<< "blocks:     " << stats.blocks << "\n"
+		<< "threads:    " << tessellationPool->size() << "\n"
+		<< "total:      " << (finished - start) * 1000.0 << " ms\n"
+		<< "peak RSS:   " << peakMemory() / (1024.0 * 1024.0) << " MB" << std::endl;
+	return 0;
+}
+
+int runBatch(const CommandLine& cmd) {
+	initTessellator();
+
+	if (cmd.stream) {
+		return runStream(cmd);
+	}
+
+	beginProfileFrame();
+	double start = currentTime();
+	if (!loadScene(cmd.input)) {
+		return 1;
+	}
+	double loaded = currentTime();
+
+	if (!cmd.convert.empty() && !writeBinaryScene(cmd.convert)) {
+		return 1;
+	}
+	double converted = currentTime();
+
+	if (viewDependent) {
+		tessellationView.orthographic(1.0, 0.0, 0.0, sceneExtent, sceneExtent,
+			cmd.width, cmd.height);
+	}
+
+	// Headless culling sees the scene as the window first shows it
+	std::vector<unsigned char> visible;
+	CullStats culled;
+	if (cullBackFaces && cmd.tessellate) {
+		float modelview[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+		float projection[16];
+		orthographicMatrix(-sceneExtent, sceneExtent, -sceneExtent, sceneExtent, -100.0, 100.0,
+			projection);
+		ViewVolume view;
+		view.set(modelview, projection);
+		computePatchBounds();
+		culled = cullPatches(view, visible);
+	}
+
+	Mesh mesh;
+	if (cmd.tessellate) {
+		tessellate(mesh, visible.empty() ? NULL : &visible[0]);
+	}
+	double tessellated = currentTime();
+
+	if (!cmd.output.empty() && !writeMesh(mesh, cmd.output)) {
+		return 1;
+	}
+	double written = currentTime();
+	endProfileFrame();
+	if (!cmd.profile.empty() && !writeProfile(cmd.profile)) {
+		return 1;
+	}
+
+	std::cout << "patches:    " << numPatches << "\n";
+	if (cmd.tessellate) {
+		std::cout << "vertices:   " << mesh.vertices.size() << "\n"
+			<< "triangles:  " << mesh.indices.size() / 3 << "\n"
+			<< "threads:    " << tessellationPool->size() << "\n";
+	}
+	if (!visible.empty()) {
+		std::cout << "culled:     " << culled.outside + culled.backFacing << " ("
+			<< culled.outside << " outside, " << culled.backFacing << " back-facing)\n";
+	}
+	std::cout << "load:       " << (loaded - start) * 1000.0 << " ms\n";
+	if (!cmd.convert.empty()) {
+		std::cout << "convert:    " << (converted - loaded) * 1000.0 << " ms\n";
+	}
+	if (cmd.tessellate) {
+		std::cout << "tessellate: " << (tessellated - converted) * 1000.0 << " ms\n";
+	}
+	if (!cmd.output.empty()) {
+		std::cout << "write:      " << (written - tessellated) * 1000.0 << " ms\n";
+	}
+	std::cout << "total:      " << (written - start) * 1000.0 << " ms\n"
+		<< "peak RSS:   " << peakMemory() / (1024.0 * 1024.0) << " MB" << std::endl;
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <cstddef>
+
+//****************************************************
+// Command line and headless batch tessellation
+//****************************************************
+
+// Side of the window at startup, in pixels, unless --size says otherwise;
+// headless view-dependent runs measure pixel error on that opening view
+const int initialWindowSize = 1000;
+
+class CommandLine {
+public:
+	std::string input;
+	std::string output;		// mesh file to write, empty for none
+	std::string convert;	// binary scene file to write, empty for none
+	bool headless;			// tessellate without GL and report statistics
+	bool tessellate;		// false when only converting (no step size given)
+	bool stream;			// tessellate cmd.input into cmd.output block by block
+	int offscreenFrames;	// render this many frames without a window, 0 for none
+	std::string ppm;		// where to dump the last offscreen frame, empty for none
+	int width, height;		// window or offscreen framebuffer size
+	std::string profile;	// where to write timings and counters, empty for none
+
+	CommandLine() : headless(false), tessellate(true), stream(false), offscreenFrames(0),
+		width(initialWindowSize), height(initialWindowSize) {}
+};
+
+// Parses "<file.bez> <step> [options]" (or "<file.bez> --convert <file.bzb>")
+// into cmd and the tessellation
+// globals; returns false (after printing why) on bad arguments or --help
+bool parseCommandLine(int argc, char* argv[], CommandLine& cmd);
+
+void printUsage(const char* program);
+
+// Loads cmd.input, writes cmd.convert if given, then tessellates it and
+// writes cmd.output if given, printing counts, timings and peak memory, and
+// writes the whole run as one profile frame to cmd.profile if given.
+// Returns the process exit code.
+int runBatch(const CommandLine& cmd);
+
+// Peak resident set size of this process in bytes, 0 if unknown
+size_t peakMemory();
+
+#endif
@@ -0,0 +1,392 @@
+#include "Bezier.h"
+#include "Adaptive.h"
+#include "Batch.h"
+#include "Scene.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//****************************************************
+// Tessellation benchmarks
+//
+// Times bernstein(), patchPoint(), the uniform traversals and adaptive
+// subdivision on .bez files and on synthetic models, and prints the rates
+// as JSON. Only the GL-free core is linked, so nothing is drawn: each patch
+// is tessellated into a scratch mesh that is reused for the next one.
+//****************************************************
+
+namespace {
+
+class BenchOptions {
+public:
+	std::vector<std::string> models;
+	std::vector<int> synthetic;
+	std::vector<float> steps;
+	std::vector<float> tolerances;
+	double seconds;
+	std::string output;
+
+	BenchOptions() : seconds(0.5) {}
+};
+
+class BenchResult {
+public:
+	std::string model;
+	size_t modelPatches;
+	std::string benchmark;
+	float step;
+	size_t patches;
+	size_t samples;
+	size_t triangles;
+	double seconds;
+};
+
+std::vector<BenchResult> results;
+volatile float sink;
+
+// Deterministic pseudo-random numbers in [0, 1)
+class Random {
+public:
+	unsigned int state;
+	Random(unsigned int seed) : state(seed) {}
+	float next() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 16777216.0f;
+	}
+};
+
+// Unit patches tiled on a square grid, each a dome of random height with
+// flat boundary curves, so neighbouring patches meet like a real model
+void syntheticModel(int count, std::vector<BPatch>& patches) {
+	Random random(count);
+	int side = (int) ceil(sqrt((double) count));
+	for (int i = 0; i < count; i++) {
+		float x0 = i % side, y0 = i / side;
+		float height = 0.2f + 0.6f * random.next();
+		Point net[4][4];
+		for (int k = 0; k < 4; k++) {
+			for (int l = 0; l < 4; l++) {
+				net[k][l].x = x0 + l / 3.0f;
+				net[k][l].y = y0 + k / 3.0f;
+				net[k][l].z = (k % 3 && l % 3) ? height : 0.0f;
+			}
+		}
+		BPatch patch;
+		BCurve* curves[4] = { &patch.c1, &patch.c2, &patch.c3, &patch.c4 };
+		for (int k = 0; k < 4; k++) {
+			curves[k]->p1 = net[k][0];
+			curves[k]->p2 = net[k][1];
+			curves[k]->p3 = net[k][2];
+			curves[k]->p4 = net[k][3];
+		}
+		patches.push_back(patch);
+	}
+}
+
+void record(const std::string& model, size_t modelPatches, const char* benchmark, float step,
+	size_t patches, size_t samples, size_t triangles, double seconds) {
+	BenchResult r;
+	r.model = model;
+	r.modelPatches = modelPatches;
+	r.benchmark = benchmark;
+	r.step = step;
+	r.patches = patches;
+	r.samples = samples;
+	r.triangles = triangles;
+	r.seconds = seconds;
+	results.push_back(r);
+
+	fprintf(stderr, "%-14s %-18s step %-6g %10.0f patches/s %12.0f samples/s %12.0f tris/s\n",
+		model.c_str(), benchmark, step, patches / seconds, samples / seconds, triangles / seconds);
+}
+
+// Evaluates bernstein() on every curve of the model at pseudo-random u
+void benchBernstein(const std::string& name, const std::vector<BPatch>& patches, double budget) {
+	Random random(1);
+	size_t calls = 0, patchCount = 0;
+	float sum = 0;
+	double start = currentTime(), elapsed = 0;
+	while (elapsed < budget) {
+		const BPatch& patch = patches[patchCount % patches.size()];
+		for (int i = 0; i < 64; i++) {
+			float u = random.next();
+			sum += bernstein(u, patch.c1).p1.x + bernstein(u, patch.c2).p1.y
+				+ bernstein(u, patch.c3).p1.z + bernstein(u, patch.c4).p2.x;
+		}
+		calls += 256;
+		patchCount++;
+		elapsed = currentTime() - start;
+	}
+	sink = sum;
+	record(name, patches.size(), "bernstein", 0, patchCount, calls, 0, elapsed);
+}
+
+// Evaluates patchPoint() on every patch at pseudo-random (u, v)
+void benchPatchPoint(const std::string& name, const std::vector<BPatch>& patches, double budget) {
+	Random random(2);
+	size_t calls = 0, patchCount = 0;
+	float sum = 0;
+	double start = currentTime(), elapsed = 0;
+	while (elapsed < budget) {
+		const BPatch& patch = patches[patchCount % patches.size()];
+		for (int i = 0; i < 64; i++) {
+			Tuple t = patchPoint(random.next(), random.next(), patch);
+			sum += t.p1.x + t.p2.y;
+		}
+		calls += 64;
+		patchCount++;
+		elapsed = currentTime() - start;
+	}
+	sink = sum;
+	record(name, patches.size(), "patchPoint", 0, patchCount, calls, 0, elapsed);
+}
+
+enum Traversal {
+	TRAVERSAL_TABLE,
+	TRAVERSAL_FORWARD,
+	TRAVERSAL_SIMD,
+	TRAVERSAL_ADAPTIVE
+};
+
+// Tessellates patches one at a time into a reused mesh until every patch
+// is done or the time budget runs out
+void benchTraversal(const std::string& name, const std::vector<BPatch>& patches,
+	Traversal traversal, float step, double budget) {
+	static const char* names[] = {
+		"curveTraversal", "forwardTraversal", "simdTraversal", "adaptiveTraversal"
+	};
+
+	stepSize = step;
+	BasisTable table;
+	updateBasisTable(table);
+	unsigned int n = table.samples.size();
+
+	std::vector<float> gridU, gridV;
+	BatchBuffer buffer;
+	if (traversal == TRAVERSAL_SIMD) {
+		for (unsigned int i = 0; i < n; i++) {
+			for (unsigned int j = 0; j < n; j++) {
+				gridU.push_back(table.samples[i]);
+				gridV.push_back(table.samples[j]);
+			}
+		}
+		buffer.resize(n * n);
+	}
+
+	AdaptiveScratch scratch;
+	Mesh mesh;
+	size_t done = 0, samples = 0, triangles = 0;
+	double start = currentTime(), elapsed = 0;
+	while (done < patches.size() && elapsed < budget) {
+		const BPatch& patch = patches[done];
+		mesh.clear();
+		switch (traversal) {
+		case TRAVERSAL_TABLE:
+			curveTraversal(patch, table, 0, n, mesh);
+			break;
+		case TRAVERSAL_FORWARD:
+			forwardTraversal(patch, n - 1, 0, n, mesh);
+			break;
+		case TRAVERSAL_SIMD:
+			simdTraversal(patch, gridU, gridV, n, 0, n, buffer, mesh);
+			break;
+		case TRAVERSAL_ADAPTIVE:
+			adaptiveTraversal(patch, scratch, mesh);
+			break;
+		}
+		samples += mesh.vertices.size();
+		triangles += mesh.indices.size() / 3;
+		done++;
+
+		// Checking the clock every patch is too costly for coarse steps
+		if (done % 16 == 0 || done == patches.size()) {
+			elapsed = currentTime() - start;
+		}
+	}
+	elapsed = currentTime() - start;
+	record(name, patches.size(), names[traversal], step, done, samples, triangles, elapsed);
+}
+
+void benchModel(const std::string& name, const std::vector<BPatch>& patches,
+	const BenchOptions& options) {
+	if (patches.empty()) {
+		return;
+	}
+	benchBernstein(name, patches, options.seconds);
+	benchPatchPoint(name, patches, options.seconds);
+	for (size_t i = 0; i < options.steps.size(); i++) {
+		benchTraversal(name, patches, TRAVERSAL_TABLE, options.steps[i], options.seconds);
+		benchTraversal(name, patches, TRAVERSAL_FORWARD, options.steps[i], options.seconds);
+		benchTraversal(name, patches, TRAVERSAL_SIMD, options.steps[i], options.seconds);
+	}
+	for (size_t i = 0; i < options.tolerances.size(); i++) {
+		benchTraversal(name, patches, TRAVERSAL_ADAPTIVE, options.tolerances[i], options.seconds);
+	}
+}
+
+std::string jsonString(const std::string& s) {
+	std::string r = "\"";
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') {
+			r += '\\';
+		}
+		r += s[i];
+	}
+	return r + "\"";
+}
+
+void writeJson(std::ostream& out) {
+	out << "{\n  \"evaluator\": \"" << patchEvaluatorName(currentPatchEvaluator()) << "\",\n"
+		<< "  \"peak_rss_bytes\": " << peakMemory() << ",\n"
+		<< "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		out << "    {\"model\": " << jsonString(r.model)
+			<< ", \"model_patches\": " << r.modelPatches
+			<< ", \"benchmark\": \"" << r.benchmark << "\""
+			<< ", \"step\": " << r.step
+			<< ", \"patches\": " << r.patches
+			<< ", \"samples\": " << r.samples
+			<< ", \"triangles\": " << r.triangles
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"patches_per_sec\": " << r.patches / r.seconds
+			<< ", \"samples_per_sec\": " << r.samples / r.seconds
+			<< ", \"triangles_per_sec\": " << r.triangles / r.seconds
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}" << std::endl;
+}
+
+// Comma-separated positive numbers; false (after printing why) if any item
+// isn't one or there are none
+template <class T>
+bool parseList(const char* option, const char* arg, std::vector<T>& list) {
+	list.clear();
+	std::stringstream ss(arg);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (item.empty()) {
+			continue;
+		}
+		char* end;
+		double value = strtod(item.c_str(), &end);
+		if (*end != '\0' || !((T) value > 0)) {
+			std::cerr << option << ": \"" << item << "\" is not a positive number" << std::endl;
+			return false;
+		}
+		list.push_back((T) value);
+	}
+	if (list.empty()) {
+		std::cerr << option << " needs at least one value" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void printBenchUsage(const char* program) {
+	std::cerr << "usage: " << program << " [options]\n"
+		<< "  --models <a.bez,b.bez>     .bez files (default: as3/teapot.bez,as3/test.bez)\n"
+		<< "  --synthetic <n,n,...>      synthetic patch counts (default: 1000,10000,100000,1000000)\n"
+		<< "  --steps <s,s,...>          uniform step sizes (default: 0.2,0.1,0.05,0.02)\n"
+		<< "  --tolerances <t,t,...>     adaptive tolerances (default: 0.1,0.05,0.02,0.01)\n"
+		<< "  --time <seconds>           time budget per case (default: 0.5)\n"
+		<< "  -o <file.json>             write JSON there instead of stdout" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	BenchOptions options;
+	options.models.push_back("as3/teapot.bez");
+	options.models.push_back("as3/test.bez");
+	parseList("--synthetic", "1000,10000,100000,1000000", options.synthetic);
+	parseList("--steps", "0.2,0.1,0.05,0.02", options.steps);
+	parseList("--tolerances", "0.1,0.05,0.02,0.01", options.tolerances);
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--models") == 0 && hasValue) {
+			options.models.clear();
+			std::stringstream ss(argv[++i]);
+			std::string item;
+			while (std::getline(ss, item, ',')) {
+				if (!item.empty()) {
+					options.models.push_back(item);
+				}
+			}
+		} else if (strcmp(argv[i], "--synthetic") == 0 && hasValue) {
+			if (!parseList(argv[i], argv[i + 1], options.synthetic)) {
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--steps") == 0 && hasValue) {
+			if (!parseList(argv[i], argv[i + 1], options.steps)) {
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--tolerances") == 0 && hasValue) {
+			if (!parseList(argv[i], argv[i + 1], options.tolerances)) {
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--time") == 0 && hasValue) {
+			options.seconds = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+			options.output = argv[++i];
+		} else {
+			printBenchUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	// Opened up front so a bad path fails before the benchmarks run
+	std::ofstream out;
+	if (!options.output.empty()) {
+		out.open(options.output.c_str());
+		if (!out) {
+			std::cerr << "Unable to write " << options.output << std::endl;
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < options.models.size(); i++) {
+		if (!loadScene(options.models[i])) {
+			continue;
+		}
+		std::vector<BPatch> patches(scenePatches, scenePatches + numPatches);
+
+		std::string name = options.models[i];
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos) {
+			name = name.substr(slash + 1);
+		}
+		benchModel(name, patches, options);
+	}
+
+	for (size_t i = 0; i < options.synthetic.size(); i++) {
+		std::vector<BPatch> patches;
+		syntheticModel(options.synthetic[i], patches);
+		std::stringstream name;
+		name << "synthetic-" << options.synthetic[i];
+		benchModel(name.str(), patches, options);
+	}
+
+	if (options.output.empty()) {
+		writeJson(std::cout);
+	} else {
+		writeJson(out);
+		out.close();
+		if (out.fail()) {
+			std::cerr << "Error writing " << options.output << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,621 @@
+#include "Bezier.h"
+#include "Profile.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace std;
+
+//****************************************************
+// Global Variables
+//****************************************************
+float stepSize;
+std::vector<BPatch> bPatches;
+int numPatches;
+const BPatch* scenePatches = NULL;
+float sceneExtent = 10;
+unsigned int sceneGeneration = 0;
+
+bool simdEvaluation = false;
+
+//****************************************************
+// Helper Methods
+//****************************************************
+
+double currentTime(){
+#ifdef _WIN32
+	return GetTickCount() / 1000.0;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+Point multiplyPoint(float s, Point p){
+	Point r;
+	r.x = p.x * s;
+	r.y = p.y * s;
+	r.z = p.z * s;
+	return r;
+}
+
+Point addPoint(Point p1, Point p2){
+	Point r;
+	r.x = p1.x + p2.x;
+	r.y = p1.y + p2.y;
+	r.z = p1.z + p2.z;
+	return r;
+}
+
+Point subtractPoint(Point p1, Point p2){
+	Point r;
+	r.x = p1.x - p2.x;
+	r.y = p1.y - p2.y;
+	r.z = p1.z - p2.z;
+	return r;
+}
+
+Point normalize(Point p){
+	Point r;
+	float len = sqrt(pow(p.x, 2.0) + pow(p.y, 2.0) + pow(p.z, 2.0));
+	r.x = p.x / len;
+	r.y = p.y / len;
+	r.z = p.z / len;
+	return r;
+}
+
+Point crossProduct(Point p1, Point p2){
+	Point r;
+	r.x = p1.y * p2.z - p1.z * p2.y;
+	r.y = p1.z * p2.x - p1.x * p2.z;
+	r.z = p1.x * p2.y - p1.y * p2.x;
+	return r;
+}
+
+Point getNormal(Point p1, Point p2, Point p3){
+	return crossProduct(subtractPoint(p3, p1), subtractPoint(p2, p1));
+}
+
+Point midPoint(Point p1, Point p2) {
+	Point r;
+	r.x = (p1.x + p2.x)/2.0;
+	r.y = (p1.y + p2.y)/2.0;
+	r.z = (p1.z + p2.z)/2.0;
+	return r;
+}
+
+float distancePoint(Point p1, Point p2) {
+	return sqrt(pow(p1.x-p2.x, 2.0) + pow(p1.y-p2.y, 2.0) + pow(p1.z-p2.z, 2.0));
+}
+
+Tuple bernstein(float u, BCurve curve){
+	Point a, b, c, d, e, p, pd;
+	Tuple output;
+
+	a = addPoint(multiplyPoint((1.0-u), curve.p1), multiplyPoint(u, curve.p2));
+	b = addPoint(multiplyPoint((1.0-u), curve.p2), multiplyPoint(u, curve.p3));
+	c = addPoint(multiplyPoint((1.0-u), curve.p3), multiplyPoint(u, curve.p4));
+
+	d = addPoint(multiplyPoint((1.0-u), a), multiplyPoint(u, b));
+	e = addPoint(multiplyPoint((1.0-u), b), multiplyPoint(u, c));
+
+	p = addPoint(multiplyPoint((1.0-u), d), multiplyPoint(u, e));
+	pd = multiplyPoint(3.0, subtractPoint(e, d));
+
+	output.p1 = p;
+	output.p2 = pd;
+	return output;
+}
+
+Tuple patchPoint(float u, float v, BPatch patch) {
+	countEvent(COUNTER_PATCH_EVALUATIONS);
+	BCurve vcurve, ucurve;
+	Point p, dPdv, dPdu, n;
+
+	BCurve hc1, hc2, hc3, hc4;
+
+	hc1.p1 = patch.c1.p1;
+	hc1.p2 = patch.c2.p1;
+	hc1.p3 = patch.c3.p1;
+	hc1.p4 = patch.c4.p1;
+
+	hc2.p1 = patch.c1.p2;
+	hc2.p2 = patch.c2.p2;
+	hc2.p3 = patch.c3.p2;
+	hc2.p4 = patch.c4.p2;
+
+	hc3.p1 = patch.c1.p3;
+	hc3.p2 = patch.c2.p3;
+	hc3.p3 = patch.c3.p3;
+	hc3.p4 = patch.c4.p3;
+
+	hc4.p1 = patch.c1.p4;
+	hc4.p2 = patch.c2.p4;
+	hc4.p3 = patch.c3.p4;
+	hc4.p4 = patch.c4.p4;
+
+	vcurve.p1 = bernstein(u, patch.c1).p1;
+	vcurve.p2 = bernstein(u, patch.c2).p1;
+	vcurve.p3 = bernstein(u, patch.c3).p1;
+	vcurve.p4 = bernstein(u, patch.c4).p1;
+
+	ucurve.p1 = bernstein(v, hc1).p1;
+	ucurve.p2 = bernstein(v, hc2).p1;
+	ucurve.p3 = bernstein(v, hc3).p1;
+	ucurve.p4 = bernstein(v, hc4).p1;
+
+	Tuple temp1 = bernstein(v, vcurve);
+	Tuple temp2 = bernstein(u, ucurve);
+	p = temp1.p1;
+	dPdv = temp1.p2;
+	dPdu = temp2.p2;
+
+	n = crossProduct(dPdu, dPdv);
+	Tuple output;
+	output.p1 = p;
+	output.p2 = n;
+	return output;
+}
+
+unsigned int addVertex(Mesh& mesh, Point p, Point n){
+	Vertex vert;
+	vert.p = p;
+	vert.n = n;
+	mesh.vertices.push_back(vert);
+	return mesh.vertices.size() - 1;
+}
+
+// Evaluates up to four parametric points (x = u, y = v) at once with the
+// SIMD evaluator, returning positions and normals like patchPoint()
+void patchPointBatch(const PatchSoA& soa, const Point* params, Tuple* out, int count){
+	float u[4], v[4], values[9][4];
+	PatchBatch batch;
+	batch.px = values[0];
+	batch.py = values[1];
+	batch.pz = values[2];
+	batch.dux = values[3];
+	batch.duy = values[4];
+	batch.duz = values[5];
+	batch.dvx = values[6];
+	batch.dvy = values[7];
+	batch.dvz = values[8];
+
+	countEvent(COUNTER_PATCH_EVALUATIONS, count);
+	for (int i = 0; i < count; i++) {
+		u[i] = params[i].x;
+		v[i] = params[i].y;
+	}
+	evaluatePatchBatch(soa, u, v, count, batch);
+
+	for (int i = 0; i < count; i++) {
+		Point dPdu, dPdv;
+		out[i].p1.x = values[0][i];
+		out[i].p1.y = values[1][i];
+		out[i].p1.z = values[2][i];
+		dPdu.x = values[3][i];
+		dPdu.y = values[4][i];
+		dPdu.z = values[5][i];
+		dPdv.x = values[6][i];
+		dPdv.y = values[7][i];
+		dPdv.z = values[8][i];
+		out[i].p2 = crossProduct(dPdu, dPdv);
+	}
+}
+
+// Number of uniform steps across [0,1]. The small slack keeps step sizes
+// like 0.1 from producing a sliver final step due to float rounding.
+int uniformSteps(){
+	int steps = (int) ceil(1.0 / stepSize - 1e-4);
+	return steps < 1 ? 1 : steps;
+}
+
+// Parameter values visited by the uniform tessellation: i / steps for
+// steps = uniformSteps(), so a step size that does not divide 1 is spread
+// evenly instead of leaving a short last step (forwardTraversal() walks the
+// same grid from the step count alone)
+void uniformSamples(std::vector<float>& samples){
+	int steps = uniformSteps();
+	samples.resize(steps + 1);
+	for (int i = 0; i < steps; i++) {
+		samples[i] = (float) i / steps;
+	}
+	samples[steps] = 1.0;
+}
+
+// Rebuilds the basis table when the step size (and so the sample count
+// and positions) no longer matches the one it was built for
+void updateBasisTable(BasisTable& table){
+	if (table.step == stepSize && !table.samples.empty()) {
+		return;
+	}
+
+	std::vector<float> samples;
+	uniformSamples(samples);
+	fillBasisTable(table, samples);
+	table.step = stepSize;
+}
+
+void fillBasisTable(BasisTable& table, const std::vector<float>& samples){
+	table.samples = samples;
+	table.b.resize(table.samples.size() * 4);
+	table.db.resize(table.samples.size() * 4);
+
+	for (unsigned int i = 0; i < table.samples.size(); i++) {
+		bernsteinWeights(table.samples[i], &table.b[i * 4], &table.db[i * 4]);
+	}
+}
+
+void bernsteinWeights(float u, float* b, float* db){
+	float s = 1.0 - u;
+
+	b[0] = s * s * s;
+	b[1] = 3.0 * u * s * s;
+	b[2] = 3.0 * u * u * s;
+	b[3] = u * u * u;
+
+	db[0] = -3.0 * s * s;
+	db[1] = 3.0 * s * s - 6.0 * u * s;
+	db[2] = 6.0 * u * s - 3.0 * u * u;
+	db[3] = 3.0 * u * u;
+}
+
+// Control points indexed as net[curve][point]; curves run along u and
+// successive curves step along v
+void controlNet(const BPatch& patch, Point net[4][4]){
+	const BCurve* curves[4] = { &patch.c1, &patch.c2, &patch.c3, &patch.c4 };
+	for (int k = 0; k < 4; k++) {
+		net[k][0] = curves[k]->p1;
+		net[k][1] = curves[k]->p2;
+		net[k][2] = curves[k]->p3;
+		net[k][3] = curves[k]->p4;
+	}
+}
+
+namespace {
+
+// A patch side by its four boundary control points, ordered so that both
+// patches sharing the side produce the same key
+class SideKey {
+public:
+	float coords[12];
+	int side;		// patch * 4 + side
+
+	bool operator<(const SideKey& other) const {
+		return std::lexicographical_compare(coords, coords + 12, other.coords, other.coords + 12);
+	}
+	bool operator==(const SideKey& other) const {
+		return std::equal(coords, coords + 12, other.coords);
+	}
+};
+
+bool pointLess(const Point& a, const Point& b) {
+	if (a.x != b.x) return a.x < b.x;
+	if (a.y != b.y) return a.y < b.y;
+	return a.z < b.z;
+}
+
+}
+
+void matchPatchSides(const BPatch* patches, size_t count, std::vector<int>& sides){
+	sides.assign(count * 4, -1);
+
+	std::vector<SideKey> keys;
+	keys.reserve(count * 4);
+	for (size_t i = 0; i < count; i++) {
+		Point net[4][4];
+		controlNet(patches[i], net);
+
+		for (int side = 0; side < 4; side++) {
+			Point points[4];
+			for (int t = 0; t < 4; t++) {
+				switch (side) {
+				case 0: points[t] = net[0][t]; break;
+				case 1: points[t] = net[t][3]; break;
+				case 2: points[t] = net[3][t]; break;
+				default: points[t] = net[t][0]; break;
+				}
+			}
+			if (!pointLess(points[0], points[3]) && !pointLess(points[3], points[0])) {
+				continue;
+			}
+			if (pointLess(points[3], points[0])) {
+				std::reverse(points, points + 4);
+			}
+
+			SideKey key;
+			for (int t = 0; t < 4; t++) {
+				key.coords[t * 3] = points[t].x;
+				key.coords[t * 3 + 1] = points[t].y;
+				key.coords[t * 3 + 2] = points[t].z;
+			}
+			key.side = i * 4 + side;
+			keys.push_back(key);
+		}
+	}
+
+	std::sort(keys.begin(), keys.end());
+	for (size_t a = 0; a < keys.size(); ) {
+		size_t b = a + 1;
+		while (b < keys.size() && keys[b] == keys[a]) {
+			b++;
+		}
+		if (b - a == 2) {
+			sides[keys[a].side] = keys[a + 1].side;
+			sides[keys[a + 1].side] = keys[a].side;
+		}
+		a = b;
+	}
+}
+
+void patchSoA(const BPatch& patch, PatchSoA& soa){
+	Point net[4][4];
+	controlNet(patch, net);
+	for (int k = 0; k < 4; k++) {
+		for (int l = 0; l < 4; l++) {
+			soa.x[k * 4 + l] = net[k][l].x;
+			soa.y[k * 4 + l] = net[k][l].y;
+			soa.z[k * 4 + l] = net[k][l].z;
+		}
+	}
+}
+
+// Weighted sum of four points
+Point combine(const float* w, const Point* p){
+	Point r;
+	r.x = w[0] * p[0].x + w[1] * p[1].x + w[2] * p[2].x + w[3] * p[3].x;
+	r.y = w[0] * p[0].y + w[1] * p[1].y + w[2] * p[2].y + w[3] * p[3].y;
+	r.z = w[0] * p[0].z + w[1] * p[1].z + w[2] * p[2].z + w[3] * p[3].z;
+	return r;
+}
+
+// Two triangles per cell of an n x n vertex grid stored row by row (u major),
+// for the cells whose first row is in [rowBegin, rowEnd). base is the index
+// of vertex (rowBegin, 0); the last cell row refers to vertex row rowEnd,
+// which directly follows when a patch is tessellated as consecutive strips.
+void addGridIndices(Mesh& mesh, unsigned int base, unsigned int n, unsigned int rowBegin, unsigned int rowEnd){
+	if (rowEnd > n - 1) {
+		rowEnd = n - 1;
+	}
+	for (unsigned int i = rowBegin; i < rowEnd; i++) {
+		for (unsigned int j = 0; j + 1 < n; j++) {
+			unsigned int i1 = base + (i - rowBegin) * n + j;	// (old_u, old_v)
+			unsigned int i2 = i1 + n;					// (new_u, old_v)
+			unsigned int i3 = i1 + 1;					// (old_u, new_v)
+			unsigned int i4 = i2 + 1;					// (new_u, new_v)
+
+			mesh.indices.push_back(i2);
+			mesh.indices.push_back(i4);
+			mesh.indices.push_back(i1);
+
+			mesh.indices.push_back(i4);
+			mesh.indices.push_back(i3);
+			mesh.indices.push_back(i1);
+		}
+	}
+}
+
+// Evaluates the (n+1)x(n+1) sample grid once and indexes two triangles per
+// cell over it, so interior samples are shared by their four cells. Each
+// sample is a contraction of the control net with tabulated weights: the
+// four curves are reduced to a v-curve once per u sample, then that curve
+// is evaluated at every v sample.
+//
+// Only vertex rows [rowBegin, rowEnd) are produced (see addGridIndices()).
+void curveTraversal(const BPatch& patch, const BasisTable& table,
+	unsigned int rowBegin, unsigned int rowEnd, Mesh& mesh){
+	unsigned int base = mesh.vertices.size();
+	unsigned int n = table.samples.size();
+
+	Point net[4][4];
+	controlNet(patch, net);
+
+	for (unsigned int i = rowBegin; i < rowEnd; i++) {
+		const float* bu = &table.b[i * 4];
+		const float* dbu = &table.db[i * 4];
+
+		Point vcurve[4], dvcurve[4];
+		for (int k = 0; k < 4; k++) {
+			vcurve[k] = combine(bu, net[k]);
+			dvcurve[k] = combine(dbu, net[k]);
+		}
+
+		for (unsigned int j = 0; j < n; j++) {
+			const float* bv = &table.b[j * 4];
+			const float* dbv = &table.db[j * 4];
+
+			Point p = combine(bv, vcurve);
+			Point dPdv = combine(dbv, vcurve);
+			Point dPdu = combine(bv, dvcurve);
+			addVertex(mesh, p, crossProduct(dPdu, dPdv));
+		}
+	}
+
+	addGridIndices(mesh, base, n, rowBegin, rowEnd);
+	countEvent(COUNTER_PATCH_EVALUATIONS, mesh.vertices.size() - base);
+}
+
+// Same grid as curveTraversal(), evaluated in one batch by the SIMD
+// evaluator. gridU/gridV hold the parameters of every grid sample in vertex
+// order.
+void simdTraversal(const BPatch& patch, const std::vector<float>& gridU,
+	const std::vector<float>& gridV, unsigned int n, unsigned int rowBegin, unsigned int rowEnd,
+	BatchBuffer& buffer, Mesh& mesh){
+	unsigned int base = mesh.vertices.size();
+	int first = rowBegin * n;
+	int count = (rowEnd - rowBegin) * n;
+
+	PatchSoA soa;
+	patchSoA(patch, soa);
+	evaluatePatchBatch(soa, &gridU[first], &gridV[first], count, buffer.batch);
+
+	const PatchBatch& b = buffer.batch;
+	mesh.vertices.resize(base + count);
+	Vertex* out = &mesh.vertices[base];
+	for (int s = 0; s < count; s++) {
+		Point dPdu, dPdv;
+		out[s].p.x = b.px[s];
+		out[s].p.y = b.py[s];
+		out[s].p.z = b.pz[s];
+		dPdu.x = b.dux[s];
+		dPdu.y = b.duy[s];
+		dPdu.z = b.duz[s];
+		dPdv.x = b.dvx[s];
+		dPdv.y = b.dvy[s];
+		dPdv.z = b.dvz[s];
+		out[s].n = crossProduct(dPdu, dPdv);
+	}
+
+	addGridIndices(mesh, base, n, rowBegin, rowEnd);
+	countEvent(COUNTER_PATCH_EVALUATIONS, count);
+}
+
+// Forward differences of a cubic polynomial (or, with d3 = 0, a quadratic)
+// sampled at a fixed step. Kept in double so the running sums stay within
+// float precision of direct evaluation over thousands of steps.
+class ForwardDifference {
+public:
+	double f[3], d1[3], d2[3], d3[3];
+
+	// The Bezier curve with control points p[0..3], starting at t0
+	void setCubic(const Point* p, float h, double t0 = 0.0) {
+		double a[3], b[3], c[3], d[3];
+		powerBasis(p, a, b, c, d);
+		shift(a, b, c, d, t0);
+		double h2 = (double) h * h, h3 = h2 * h;
+		for (int i = 0; i < 3; i++) {
+			f[i] = d[i];
+			d1[i] = a[i] * h3 + b[i] * h2 + c[i] * h;
+			d2[i] = 6.0 * a[i] * h3 + 2.0 * b[i] * h2;
+			d3[i] = 6.0 * a[i] * h3;
+		}
+	}
+
+	// The derivative of the Bezier curve with control points p[0..3],
+	// starting at t0
+	void setDerivative(const Point* p, float h, double t0 = 0.0) {
+		double a[3], b[3], c[3], d[3];
+		powerBasis(p, a, b, c, d);
+		shift(a, b, c, d, t0);
+		double h2 = (double) h * h;
+		for (int i = 0; i < 3; i++) {
+			f[i] = c[i];
+			d1[i] = 3.0 * a[i] * h2 + 2.0 * b[i] * h;
+			d2[i] = 6.0 * a[i] * h2;
+			d3[i] = 0.0;
+		}
+	}
+
+	void step() {
+		for (int i = 0; i < 3; i++) {
+			f[i] += d1[i];
+			d1[i] += d2[i];
+			d2[i] += d3[i];
+		}
+	}
+
+	Point value() const {
+		Point r;
+		r.x = f[0];
+		r.y = f[1];
+		r.z = f[2];
+		return r;
+	}
+
+private:
+	static double coord(const Point& p, int i) {
+		return i == 0 ? p.x : (i == 1 ? p.y : p.z);
+	}
+
+	// a t^3 + b t^2 + c t + d
+	static void powerBasis(const Point* p, double* a, double* b, double* c, double* d) {
+		for (int i = 0; i < 3; i++) {
+			double p0 = coord(p[0], i), p1 = coord(p[1], i);
+			double p2 = coord(p[2], i), p3 = coord(p[3], i);
+			a[i] = p3 - 3.0 * p2 + 3.0 * p1 - p0;
+			b[i] = 3.0 * (p2 - 2.0 * p1 + p0);
+			c[i] = 3.0 * (p1 - p0);
+			d[i] = p0;
+		}
+	}
+
+	// Rewrites the coefficients as a polynomial in s = t - t0
+	static void shift(double* a, double* b, double* c, double* d, double t0) {
+		if (t0 == 0.0) {
+			return;
+		}
+		for (int i = 0; i < 3; i++) {
+			d[i] = ((a[i] * t0 + b[i]) * t0 + c[i]) * t0 + d[i];
+			c[i] = (3.0 * a[i] * t0 + 2.0 * b[i]) * t0 + c[i];
+			b[i] = 3.0 * a[i] * t0 + b[i];
+		}
+	}
+};
+
+// The grid i / steps of uniformSamples(), walked with bicubic forward
+// differences: the four curves are differenced along u, and each resulting
+// v-curve is differenced along v, so every sample costs only additions plus
+// the normal's cross product. The clamped final sample (u or v = 1) is taken exactly from
+// the curve end points instead of one more difference step. Positions agree
+// with curveTraversal() to within 1e-5 of the model size and normals to
+// within 1e-3 relative, except near degenerate points where the normal
+// vanishes.
+//
+// Only vertex rows [rowBegin, rowEnd) are produced (see addGridIndices()).
+void forwardTraversal(const BPatch& patch, unsigned int steps, unsigned int rowBegin, unsigned int rowEnd,
+	Mesh& mesh){
+	unsigned int base = mesh.vertices.size();
+
+	Point net[4][4];
+	controlNet(patch, net);
+
+	float h = 1.0f / steps;
+	ForwardDifference curves[4], dcurves[4];
+	for (int k = 0; k < 4; k++) {
+		curves[k].setCubic(net[k], h, (double) rowBegin / steps);
+		dcurves[k].setDerivative(net[k], h, (double) rowBegin / steps);
+	}
+
+	for (unsigned int i = rowBegin; i < rowEnd; i++) {
+		Point vcurve[4], dvcurve[4];
+		for (int k = 0; k < 4; k++) {
+			if (i < steps) {
+				vcurve[k] = curves[k].value();
+				dvcurve[k] = dcurves[k].value();
+				curves[k].step();
+				dcurves[k].step();
+			} else {
+				vcurve[k] = net[k][3];
+				dvcurve[k] = multiplyPoint(3.0, subtractPoint(net[k][3], net[k][2]));
+			}
+		}
+
+		ForwardDifference p, dPdv, dPdu;
+		p.setCubic(vcurve, h);
+		dPdv.setDerivative(vcurve, h);
+		dPdu.setCubic(dvcurve, h);
+
+		for (unsigned int j = 0; j < steps; j++) {
+			addVertex(mesh, p.value(), crossProduct(dPdu.value(), dPdv.value()));
+			p.step();
+			dPdv.step();
+			dPdu.step();
+		}
+		addVertex(mesh, vcurve[3], crossProduct(dvcurve[3],
+			multiplyPoint(3.0, subtractPoint(vcurve[3], vcurve[2]))));
+	}
+
+	addGridIndices(mesh, base, steps + 1, rowBegin, rowEnd);
+	countEvent(COUNTER_PATCH_EVALUATIONS, mesh.vertices.size() - base);
+}
@@ -0,0 +1,169 @@
+#ifndef BEZIER_H
+#define BEZIER_H
+
+#include <vector>
+#include <string>
+
+#include "PatchSimd.h"
+
+//****************************************************
+// Bezier patch geometry, evaluation and per-patch tessellation. Nothing in
+// here touches GL, so it is shared by the viewer and the headless tools.
+//****************************************************
+
+//****************************************************
+// Helper Classes
+//****************************************************
+
+class Point {
+public:
+	float x, y, z;
+};
+
+class BCurve {
+public:
+	Point p1, p2, p3, p4;
+};
+
+class BPatch {
+public:
+	BCurve c1, c2, c3, c4;
+};
+
+class Tuple {
+public:
+	Point p1, p2;
+};
+
+// Cubic Bernstein weights B0..B3 and their derivatives at every sample of
+// the uniform tessellation, shared by all patches
+class BasisTable {
+public:
+	float step;
+	std::vector<float> samples;
+	std::vector<float> b, db; // 4 weights per sample
+
+	BasisTable() : step(0.0) {}
+};
+
+// Output storage for evaluatePatchBatch()
+class BatchBuffer {
+public:
+	std::vector<float> data;
+	PatchBatch batch;
+
+	void resize(int count) {
+		data.resize(count * 9);
+		float* d = &data[0];
+		batch.px = d;
+		batch.py = d + count;
+		batch.pz = d + count * 2;
+		batch.dux = d + count * 3;
+		batch.duy = d + count * 4;
+		batch.duz = d + count * 5;
+		batch.dvx = d + count * 6;
+		batch.dvy = d + count * 7;
+		batch.dvz = d + count * 8;
+	}
+};
+
+class Vertex {
+public:
+	Point p, n;
+};
+
+class Mesh {
+public:
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	// Patch i's triangles are indices [patchStarts[i], patchStarts[i + 1]),
+	// when the mesh comes from tessellatePatches(); culled patches are empty
+	std::vector<unsigned int> patchStarts;
+
+	void clear() {
+		vertices.clear();
+		indices.clear();
+		patchStarts.clear();
+	}
+};
+
+//****************************************************
+// Global Variables
+//****************************************************
+extern float stepSize;
+extern std::vector<BPatch> bPatches;
+extern int numPatches;
+
+// The loaded model, numPatches long. Points into bPatches for text scenes,
+// or straight into the mapping of a binary scene file.
+extern const BPatch* scenePatches;
+
+// Largest control point coordinate of the loaded scene
+extern float sceneExtent;
+
+// Bumped by every scene load, so data kept per scene can tell a new scene
+// from the old one even when it lands at the same address
+extern unsigned int sceneGeneration;
+
+// Use the batched SIMD evaluator (PatchSimd.h) in both modes
+extern bool simdEvaluation;
+
+//****************************************************
+// Helper Methods
+//****************************************************
+
+// Wall clock in seconds
+double currentTime();
+
+Point multiplyPoint(float s, Point p);
+Point addPoint(Point p1, Point p2);
+Point subtractPoint(Point p1, Point p2);
+Point normalize(Point p);
+Point crossProduct(Point p1, Point p2);
+Point getNormal(Point p1, Point p2, Point p3);
+Point midPoint(Point p1, Point p2);
+float distancePoint(Point p1, Point p2);
+
+Tuple bernstein(float u, BCurve curve);
+Tuple patchPoint(float u, float v, BPatch patch);
+void patchPointBatch(const PatchSoA& soa, const Point* params, Tuple* out, int count);
+
+// Control points indexed as net[curve][point]; curves run along u and
+// successive curves step along v
+void controlNet(const BPatch& patch, Point net[4][4]);
+void patchSoA(const BPatch& patch, PatchSoA& soa);
+
+// Pairs up the sides of patches [0, count) whose boundary curves are
+// identical: sides[i * 4 + s] is the matching side (neighbour * 4 + its
+// side) of side s of patch i, or -1. Sides are in grid order: v = 0, u = 1,
+// v = 1, u = 0. Sides that collapse to a point (poles) or are shared by
+// more than two patches are left unpaired.
+void matchPatchSides(const BPatch* patches, size_t count, std::vector<int>& sides);
+
+unsigned int addVertex(Mesh& mesh, Point p, Point n);
+
+//****************************************************
+// Uniform tessellation
+//****************************************************
+int uniformSteps();
+void uniformSamples(std::vector<float>& samples);
+void updateBasisTable(BasisTable& table);
+// Cubic Bernstein weights b and their derivatives db at u
+void bernsteinWeights(float u, float* b, float* db);
+// Weighted sum of four points
+Point combine(const float* w, const Point* p);
+// Tabulates the weights at arbitrary samples (table.step is left alone)
+void fillBasisTable(BasisTable& table, const std::vector<float>& samples);
+
+// Each traversal produces vertex rows [rowBegin, rowEnd) of one patch's
+// sample grid plus the cells that start in them
+void curveTraversal(const BPatch& patch, const BasisTable& table,
+	unsigned int rowBegin, unsigned int rowEnd, Mesh& mesh);
+void simdTraversal(const BPatch& patch, const std::vector<float>& gridU,
+	const std::vector<float>& gridV, unsigned int n, unsigned int rowBegin, unsigned int rowEnd,
+	BatchBuffer& buffer, Mesh& mesh);
+void forwardTraversal(const BPatch& patch, unsigned int steps, unsigned int rowBegin, unsigned int rowEnd,
+	Mesh& mesh);
+
+#endif
@@ -0,0 +1,136 @@
+#include "Bezier.h"
+#include "Tessellator.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+//****************************************************
+// Regression checks, run by "make check" from the top of the tree. Each
+// check prints what it found and returns whether it held.
+//****************************************************
+
+static const char* checkScene = "as3/teapot.bez";
+
+static bool report(const std::string& name, bool held, const std::string& detail) {
+	std::cout << (held ? "ok    " : "FAIL  ") << name << ": " << detail << std::endl;
+	return held;
+}
+
+//****************************************************
+// Adaptive limits
+//
+// A tolerance far below the model's scale refines as deep as the grid
+// allows, so only the limits stop it
+//****************************************************
+
+static void resetAdaptive() {
+	adaptive = true;
+	stepSize = 0.0000001;
+	adaptiveMaxDepth = 0;
+	adaptiveMaxTriangles = 0;
+	adaptiveMaxSeconds = 0.0;
+}
+
+static bool checkTriangleBudget() {
+	resetAdaptive();
+	adaptiveMaxTriangles = 1000;
+	Mesh mesh;
+	tessellate(mesh);
+	size_t triangles = mesh.indices.size() / 3;
+	return report("adaptive --max-triangles 1000", triangles <= adaptiveMaxTriangles,
+		std::to_string(triangles) + " triangles");
+}
+
+// The limit bounds refinement; splicing the patches' output after it and the
+// scheduler get a little slack
+static bool checkTimeBudget() {
+	resetAdaptive();
+	adaptiveMaxSeconds = 0.05;
+	Mesh mesh;
+	double start = currentTime();
+	tessellate(mesh);
+	double elapsed = currentTime() - start;
+	return report("adaptive --max-ms 50", elapsed <= adaptiveMaxSeconds * 1.25 + 0.005,
+		std::to_string(elapsed * 1000.0) + " ms, " + std::to_string(mesh.indices.size() / 3) + " triangles");
+}
+
+// Each split makes at most four triangles, and the sides are capped alike
+static bool checkDepthLimit() {
+	resetAdaptive();
+	adaptiveMaxDepth = 4;
+	Mesh mesh;
+	tessellate(mesh);
+	size_t triangles = mesh.indices.size() / 3;
+	size_t bound = (size_t) numPatches * 2 * 256;
+	return report("adaptive --max-depth 4", triangles <= bound,
+		std::to_string(triangles) + " triangles, at most " + std::to_string(bound));
+}
+
+//****************************************************
+// Forward differencing
+//
+// forwardTraversal() takes its grid from the step count alone, so ask for
+// one that 1 / stepSize does not give and compare it with the tabulated
+// traversal over the same samples
+//****************************************************
+
+static float pointDistance(const Point& a, const Point& b) {
+	float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+static float pointLength(const Point& a) {
+	return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+}
+
+static bool checkForwardTraversal() {
+	const unsigned int steps = 7;
+	stepSize = 0.1;
+	std::vector<float> samples(steps + 1);
+	for (unsigned int i = 0; i <= steps; i++) {
+		samples[i] = (float) i / steps;
+	}
+	BasisTable table;
+	fillBasisTable(table, samples);
+
+	Mesh tableMesh, forwardMesh;
+	for (int i = 0; i < numPatches; i++) {
+		curveTraversal(scenePatches[i], table, 0, steps + 1, tableMesh);
+		forwardTraversal(scenePatches[i], steps, 0, steps + 1, forwardMesh);
+	}
+
+	bool held = tableMesh.vertices.size() == forwardMesh.vertices.size()
+		&& tableMesh.indices == forwardMesh.indices;
+	float worst = 0.0;
+	for (size_t i = 0; held && i < tableMesh.vertices.size(); i++) {
+		const Vertex& a = tableMesh.vertices[i];
+		const Vertex& b = forwardMesh.vertices[i];
+		worst = std::max(worst, pointDistance(a.p, b.p));
+		// Normals vanish at degenerate points; compare only the real ones
+		float length = pointLength(a.n);
+		if (length > 1e-3f * sceneExtent * sceneExtent && pointDistance(a.n, b.n) > 1e-3f * length) {
+			held = false;
+		}
+	}
+	held = held && worst <= 1e-5f * sceneExtent;
+	return report("forwardTraversal 7 steps at stepSize 0.1", held,
+		std::to_string(forwardMesh.vertices.size()) + " vertices, largest offset "
+		+ std::to_string(worst));
+}
+
+int main() {
+	initTessellator();
+	if (!loadScene(checkScene)) {
+		return 1;
+	}
+
+	bool held = true;
+	held &= checkTriangleBudget();
+	held &= checkTimeBudget();
+	held &= checkDepthLimit();
+	held &= checkForwardTraversal();
+	return held ? 0 : 1;
+}
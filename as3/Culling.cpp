@@ -0,0 +1,222 @@
+#include "Culling.h"
+#include "Tessellator.h"
+#include "Profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+//****************************************************
+// Global Variables
+//****************************************************
+std::vector<PatchBounds> patchBounds;
+std::vector<int> patchNeighbours;
+bool cullBackFaces = false;
+
+//****************************************************
+// Bounds
+//****************************************************
+
+namespace {
+
+const float binomial2[3] = { 1, 2, 1 };
+const float binomial3[4] = { 1, 3, 3, 1 };
+const float binomial5[6] = { 1, 5, 10, 10, 5, 1 };
+
+inline float dotPoint(Point a, Point b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Box around the control points, and the cone around the Bezier
+// coefficients of the normal. With net[k][i] at v index k and u index i,
+// dPdu has the degree 2x3 net du (times 3) and dPdv the degree 3x2 net dv,
+// and a product of Bernstein polynomials of degrees m and n is
+// C(m,i) C(n,j) / C(m+n,i+j) times one of degree m+n.
+void boundPatch(const BPatch& patch, PatchBounds& bounds) {
+	Point net[4][4];
+	controlNet(patch, net);
+
+	bounds.min = bounds.max = net[0][0];
+	for (int k = 0; k < 4; k++) {
+		for (int i = 0; i < 4; i++) {
+			const Point& p = net[k][i];
+			bounds.min.x = std::min(bounds.min.x, p.x);
+			bounds.min.y = std::min(bounds.min.y, p.y);
+			bounds.min.z = std::min(bounds.min.z, p.z);
+			bounds.max.x = std::max(bounds.max.x, p.x);
+			bounds.max.y = std::max(bounds.max.y, p.y);
+			bounds.max.z = std::max(bounds.max.z, p.z);
+		}
+	}
+
+	Point du[4][3], dv[3][4];
+	for (int k = 0; k < 4; k++) {
+		for (int i = 0; i < 3; i++) {
+			du[k][i] = subtractPoint(net[k][i + 1], net[k][i]);
+			dv[i][k] = subtractPoint(net[i + 1][k], net[i][k]);
+		}
+	}
+
+	Point normals[6][6];
+	for (int k = 0; k < 6; k++) {
+		for (int i = 0; i < 6; i++) {
+			normals[k][i].x = normals[k][i].y = normals[k][i].z = 0.0;
+		}
+	}
+	for (int k = 0; k < 4; k++) {
+		for (int i = 0; i < 3; i++) {
+			for (int l = 0; l < 3; l++) {
+				for (int j = 0; j < 4; j++) {
+					float weight = binomial3[k] * binomial2[l] / binomial5[k + l]
+						* binomial2[i] * binomial3[j] / binomial5[i + j];
+					Point n = crossProduct(du[k][i], dv[l][j]);
+					normals[k + l][i + j] = addPoint(normals[k + l][i + j], multiplyPoint(weight, n));
+				}
+			}
+		}
+	}
+
+	Point axis = { 0.0, 0.0, 0.0 };
+	for (int k = 0; k < 6; k++) {
+		for (int i = 0; i < 6; i++) {
+			if (dotPoint(normals[k][i], normals[k][i]) > 0.0) {
+				normals[k][i] = normalize(normals[k][i]);
+				axis = addPoint(axis, normals[k][i]);
+			}
+		}
+	}
+
+	bounds.coneAxis.x = bounds.coneAxis.y = bounds.coneAxis.z = 0.0;
+	bounds.coneSin = 1.0;
+	if (dotPoint(axis, axis) == 0.0) {
+		return;
+	}
+	axis = normalize(axis);
+
+	float coneCos = 1.0;
+	for (int k = 0; k < 6; k++) {
+		for (int i = 0; i < 6; i++) {
+			if (dotPoint(normals[k][i], normals[k][i]) > 0.0) {
+				coneCos = std::min(coneCos, dotPoint(normals[k][i], axis));
+			}
+		}
+	}
+	if (coneCos > 0.0) {
+		bounds.coneAxis = axis;
+		bounds.coneSin = sqrt(1.0f - coneCos * coneCos);
+	}
+}
+
+}
+
+void computePatchBounds() {
+	patchBounds.resize(numPatches);
+	tessellationPool->parallelFor(numPatches, [&](int i, int) {
+		boundPatch(scenePatches[i], patchBounds[i]);
+	});
+
+	matchPatchSides(scenePatches, numPatches, patchNeighbours);
+	for (size_t s = 0; s < patchNeighbours.size(); s++) {
+		if (patchNeighbours[s] >= 0) {
+			patchNeighbours[s] /= 4;
+		}
+	}
+}
+
+//****************************************************
+// Culling
+//****************************************************
+
+void ViewVolume::set(const float modelview[16], const float projection[16]) {
+	// clip = projection * modelview; row r of a column-major m is m[r + 4c]
+	float clip[4][4];
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			clip[r][c] = 0.0;
+			for (int k = 0; k < 4; k++) {
+				clip[r][c] += projection[r + 4 * k] * modelview[k + 4 * c];
+			}
+		}
+	}
+
+	// -w <= x, y, z <= w
+	for (int axis = 0; axis < 3; axis++) {
+		for (int c = 0; c < 4; c++) {
+			planes[axis * 2][c] = clip[3][c] + clip[axis][c];
+			planes[axis * 2 + 1][c] = clip[3][c] - clip[axis][c];
+		}
+	}
+
+	// Normals go to eye space by the inverse transpose of the modelview's
+	// linear part L, so n faces the viewer (+z) when n . (row0 x row1) / det L
+	// is positive
+	Point row0 = { modelview[0], modelview[4], modelview[8] };
+	Point row1 = { modelview[1], modelview[5], modelview[9] };
+	Point row2 = { modelview[2], modelview[6], modelview[10] };
+	Point eye = crossProduct(row0, row1);
+	if (dotPoint(eye, row2) < 0.0) {
+		eye = multiplyPoint(-1.0, eye);
+	}
+	toEye = dotPoint(eye, eye) > 0.0 ? normalize(eye) : eye;
+}
+
+CullStats cullPatches(const ViewVolume& view, std::vector<unsigned char>& visible) {
+	ScopedTimer timer("cull");
+	CullStats stats;
+	std::vector<unsigned char> culledBy(patchBounds.size());
+	visible.resize(patchBounds.size());
+	for (size_t i = 0; i < patchBounds.size(); i++) {
+		const PatchBounds& bounds = patchBounds[i];
+
+		// Outside if the box corner furthest along a plane's normal is behind it
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++) {
+			const float* plane = view.planes[p];
+			float distance = plane[3]
+				+ plane[0] * (plane[0] > 0.0 ? bounds.max.x : bounds.min.x)
+				+ plane[1] * (plane[1] > 0.0 ? bounds.max.y : bounds.min.y)
+				+ plane[2] * (plane[2] > 0.0 ? bounds.max.z : bounds.min.z);
+			outside = distance < 0.0;
+		}
+
+		// Back-facing if every normal in the cone is more than 90 degrees
+		// from the viewer
+		bool backFacing = !outside && cullBackFaces
+			&& dotPoint(bounds.coneAxis, view.toEye) < -bounds.coneSin;
+
+		visible[i] = !outside && !backFacing;
+		culledBy[i] = outside ? 1 : (backFacing ? 2 : 0);
+	}
+
+	// Keep the culled patches bordering visible ones, judged on the first
+	// pass so the ring is one patch wide
+	for (size_t i = 0; i < patchBounds.size(); i++) {
+		bool kept = false;
+		for (int s = 0; s < 4 && !visible[i]; s++) {
+			int other = patchNeighbours[i * 4 + s];
+			kept = kept || (other >= 0 && culledBy[other] == 0);
+		}
+		if (kept || culledBy[i] == 0) {
+			stats.visible++;
+		} else if (culledBy[i] == 1) {
+			stats.outside++;
+		} else {
+			stats.backFacing++;
+		}
+		if (kept) {
+			visible[i] = 1;
+		}
+	}
+	return stats;
+}
+
+void orthographicMatrix(float left, float right, float bottom, float top, float zNear, float zFar,
+	float m[16]) {
+	std::fill(m, m + 16, 0.0f);
+	m[0] = 2.0f / (right - left);
+	m[5] = 2.0f / (top - bottom);
+	m[10] = -2.0f / (zFar - zNear);
+	m[12] = -(right + left) / (right - left);
+	m[13] = -(top + bottom) / (top - bottom);
+	m[14] = -(zFar + zNear) / (zFar - zNear);
+	m[15] = 1.0;
+}
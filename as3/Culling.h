@@ -0,0 +1,77 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include "Bezier.h"
+
+//****************************************************
+// Patch culling
+//
+// A patch lies inside the convex hull of its control points, so the box
+// around them bounds the surface. Its normal dPdu x dPdv is a degree 5x5
+// polynomial whose Bezier coefficients come from the control net too, and
+// every normal is a positive combination of them; the cone around those
+// coefficients holds every normal of the patch.
+//****************************************************
+
+// Conservative bounds of one patch. Every normal is within the angle whose
+// sine is coneSin of coneAxis; a patch whose normals span a half-space or
+// more has a zero axis and coneSin 1, and is never back-facing.
+class PatchBounds {
+public:
+	Point min, max;
+	Point coneAxis;
+	float coneSin;
+};
+
+// Bounds of each scene patch, filled by computePatchBounds()
+extern std::vector<PatchBounds> patchBounds;
+
+// The patch across each side of each scene patch (see matchPatchSides()),
+// or -1, filled by computePatchBounds()
+extern std::vector<int> patchNeighbours;
+
+// Also cull patches that face entirely away from the viewer. Off by default:
+// open surfaces are seen from both sides, and not every model orients its
+// patches consistently.
+extern bool cullBackFaces;
+
+// Fills patchBounds (in parallel on tessellationPool) and patchNeighbours
+// for the loaded scene
+void computePatchBounds();
+
+// What a view can see: the six clip planes of projection * modelview in
+// model space, and the direction towards the viewer
+class ViewVolume {
+public:
+	float planes[6][4];
+	Point toEye;
+
+	// From column-major GL matrices, as glGetFloatv() returns them. toEye
+	// assumes an orthographic projection looking down -z, as myReshape()
+	// sets up, and a modelview without shear.
+	void set(const float modelview[16], const float projection[16]);
+};
+
+// Per-frame culling counts
+class CullStats {
+public:
+	size_t visible;
+	size_t outside;		// entirely outside the view volume
+	size_t backFacing;	// inside, but facing away (with cullBackFaces)
+
+	CullStats() : visible(0), outside(0), backFacing(0) {}
+};
+
+// Sets visible[i] to whether patch i may show in view, and returns counts.
+// A culled patch that shares a side with one that may show is kept as well:
+// adaptive and analytic sides are only sampled alike when both patches are
+// tessellated, so dropping the neighbour could open cracks along the edge.
+CullStats cullPatches(const ViewVolume& view, std::vector<unsigned char>& visible);
+
+// The matrix of glOrtho(left, right, bottom, top, zNear, zFar), column-major
+void orthographicMatrix(float left, float right, float bottom, float top, float zNear, float zFar,
+	float m[16]);
+
+#endif
@@ -0,0 +1,229 @@
+#include "Density.h"
+#include "Profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+//****************************************************
+// Global Variables
+//****************************************************
+bool analyticDensity = false;
+
+namespace {
+
+// Cap on cells per direction, for tolerances far below the model's scale
+const unsigned int maxCells = 1024;
+
+float length(const Point& p) {
+	return sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+}
+
+// a - 2b + c
+Point secondDifference(const Point& a, const Point& b, const Point& c) {
+	return addPoint(subtractPoint(a, multiplyPoint(2.0, b)), c);
+}
+
+// Cells whose squared size times bound stays within 4 * tolerance
+unsigned int cellsFor(float bound, float tolerance) {
+	float cells = ceil(sqrt(bound / (4.0f * tolerance)));
+	return std::max(1u, (unsigned int) std::min(cells, (float) maxCells));
+}
+
+// A patch's vertices in the mesh, with their parameters for orienting the
+// stitched triangles
+class GridBuilder {
+public:
+	GridBuilder(const BPatch& patch, Mesh& mesh) : mesh(mesh) {
+		controlNet(patch, net);
+	}
+
+	// Evaluates the vertex at (u, v) as curveTraversal() does
+	unsigned int vertex(float u, float v) {
+		float bu[4], dbu[4], bv[4], dbv[4];
+		bernsteinWeights(u, bu, dbu);
+		bernsteinWeights(v, bv, dbv);
+
+		Point vcurve[4], dvcurve[4];
+		for (int k = 0; k < 4; k++) {
+			vcurve[k] = combine(bu, net[k]);
+			dvcurve[k] = combine(dbu, net[k]);
+		}
+		Point p = combine(bv, vcurve);
+		Point dPdv = combine(dbv, vcurve);
+		Point dPdu = combine(bv, dvcurve);
+
+		Point param;
+		param.x = u;
+		param.y = v;
+		param.z = 0.0;
+		params.push_back(param);
+		return addVertex(mesh, p, crossProduct(dPdu, dPdv));
+	}
+
+	// Adds the triangle counterclockwise in (u, v), like the grid cells
+	void triangle(unsigned int a, unsigned int b, unsigned int c) {
+		unsigned int base = mesh.vertices.size() - params.size();
+		const Point& pa = params[a - base];
+		const Point& pb = params[b - base];
+		const Point& pc = params[c - base];
+		float area = (pb.x - pa.x) * (pc.y - pa.y) - (pb.y - pa.y) * (pc.x - pa.x);
+		if (area == 0.0) {
+			return;
+		}
+		if (area < 0.0) {
+			std::swap(b, c);
+		}
+		mesh.indices.push_back(a);
+		mesh.indices.push_back(b);
+		mesh.indices.push_back(c);
+	}
+
+	// Cells of the grid whose vertex (i, j) is at first + i * rowLength + j
+	void cells(unsigned int first, unsigned int rowLength, unsigned int cellsU, unsigned int cellsV) {
+		for (unsigned int i = 0; i < cellsU; i++) {
+			for (unsigned int j = 0; j < cellsV; j++) {
+				unsigned int i1 = first + i * rowLength + j;			// (old_u, old_v)
+				unsigned int i2 = first + (i + 1) * rowLength + j;		// (new_u, old_v)
+				unsigned int i3 = i1 + 1;								// (old_u, new_v)
+				unsigned int i4 = i2 + 1;								// (new_u, new_v)
+
+				mesh.indices.push_back(i2);
+				mesh.indices.push_back(i4);
+				mesh.indices.push_back(i1);
+				mesh.indices.push_back(i4);
+				mesh.indices.push_back(i3);
+				mesh.indices.push_back(i1);
+			}
+		}
+	}
+
+private:
+	Point net[4][4];
+	Mesh& mesh;
+	std::vector<Point> params;
+};
+
+// A row of vertices along one side, with their positions along it in [0, 1]
+class SideRow {
+public:
+	std::vector<unsigned int> vertices;
+	std::vector<float> t;
+
+	void add(unsigned int vertex, float position) {
+		vertices.push_back(vertex);
+		t.push_back(position);
+	}
+};
+
+// Joins the outer row of a side to the inner row parallel to it, always
+// advancing along whichever row's next vertex comes first
+void stitch(GridBuilder& grid, const SideRow& outer, const SideRow& inner) {
+	size_t a = 0, b = 0;
+	while (a + 1 < outer.vertices.size() || b + 1 < inner.vertices.size()) {
+		bool advanceOuter = b + 1 == inner.vertices.size()
+			|| (a + 1 < outer.vertices.size() && outer.t[a + 1] <= inner.t[b + 1]);
+		if (advanceOuter) {
+			grid.triangle(outer.vertices[a], outer.vertices[a + 1], inner.vertices[b]);
+			a++;
+		} else {
+			grid.triangle(outer.vertices[a], inner.vertices[b + 1], inner.vertices[b]);
+			b++;
+		}
+	}
+}
+
+}
+
+void analyticCounts(const BPatch& patch, float tolerance, unsigned int counts[2]) {
+	Point net[4][4];
+	controlNet(patch, net);
+
+	float uu = 0.0, vv = 0.0, uv = 0.0;
+	for (int k = 0; k < 4; k++) {
+		for (int i = 0; i < 2; i++) {
+			uu = std::max(uu, length(secondDifference(net[k][i], net[k][i + 1], net[k][i + 2])));
+			vv = std::max(vv, length(secondDifference(net[i][k], net[i + 1][k], net[i + 2][k])));
+		}
+	}
+	for (int k = 0; k < 3; k++) {
+		for (int i = 0; i < 3; i++) {
+			Point mixed = subtractPoint(subtractPoint(net[k + 1][i + 1], net[k + 1][i]),
+				subtractPoint(net[k][i + 1], net[k][i]));
+			uv = std::max(uv, length(mixed));
+		}
+	}
+
+	// With hu^2 <= 4 tol / (Muu + Muv) and hv^2 <= 4 tol / (Mvv + Muv), and
+	// 2 hu hv <= hu^2 + hv^2, the bound above is at most tolerance
+	float muu = 6.0 * uu, mvv = 6.0 * vv, muv = 9.0 * uv;
+	counts[0] = cellsFor(muu + muv, tolerance);
+	counts[1] = cellsFor(mvv + muv, tolerance);
+}
+
+void densityTraversal(const BPatch& patch, const unsigned int counts[2], const unsigned int edges[4],
+	Mesh& mesh) {
+	unsigned int base = mesh.vertices.size();
+	unsigned int nu = counts[0], nv = counts[1];
+	GridBuilder grid(patch, mesh);
+
+	if (edges[0] == nu && edges[2] == nu && edges[1] == nv && edges[3] == nv) {
+		for (unsigned int i = 0; i <= nu; i++) {
+			for (unsigned int j = 0; j <= nv; j++) {
+				grid.vertex((float) i / nu, (float) j / nv);
+			}
+		}
+		grid.cells(base, nv + 1, nu, nv);
+		countEvent(COUNTER_PATCH_EVALUATIONS, mesh.vertices.size() - base);
+		return;
+	}
+
+	// Otherwise the ring of boundary vertices is stitched to the grid
+	// vertices inside it, which needs at least one of them
+	nu = std::max(nu, 2u);
+	nv = std::max(nv, 2u);
+	for (unsigned int i = 1; i < nu; i++) {
+		for (unsigned int j = 1; j < nv; j++) {
+			grid.vertex((float) i / nu, (float) j / nv);
+		}
+	}
+	grid.cells(base, nv - 1, nu - 2, nv - 2);
+	auto inner = [&](unsigned int i, unsigned int j) {
+		return base + (i - 1) * (nv - 1) + (j - 1);
+	};
+
+	// Sides run counterclockwise from corner s to corner s + 1. Parameters
+	// are ratios of sample numbers, so the patch across a side computes the
+	// same ones whichever way it runs.
+	unsigned int corners[4] = {
+		grid.vertex(0.0, 0.0), grid.vertex(1.0, 0.0), grid.vertex(1.0, 1.0), grid.vertex(0.0, 1.0)
+	};
+	for (int side = 0; side < 4; side++) {
+		unsigned int e = edges[side];
+		SideRow outer;
+		outer.add(corners[side], 0.0);
+		for (unsigned int a = 1; a < e; a++) {
+			float t = (float) a / e, back = (float) (e - a) / e;
+			switch (side) {
+			case 0: outer.add(grid.vertex(t, 0.0), t); break;
+			case 1: outer.add(grid.vertex(1.0, t), t); break;
+			case 2: outer.add(grid.vertex(back, 1.0), t); break;
+			default: outer.add(grid.vertex(0.0, back), t); break;
+			}
+		}
+		outer.add(corners[(side + 1) % 4], 1.0);
+
+		SideRow row;
+		unsigned int n = side % 2 == 0 ? nu : nv;
+		for (unsigned int a = 1; a < n; a++) {
+			float t = (float) a / n;
+			switch (side) {
+			case 0: row.add(inner(a, 1), t); break;
+			case 1: row.add(inner(nu - 1, a), t); break;
+			case 2: row.add(inner(nu - a, nv - 1), t); break;
+			default: row.add(inner(1, nv - a), t); break;
+			}
+		}
+		stitch(grid, outer, row);
+	}
+	countEvent(COUNTER_PATCH_EVALUATIONS, mesh.vertices.size() - base);
+}
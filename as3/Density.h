@@ -0,0 +1,37 @@
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include "Bezier.h"
+
+//****************************************************
+// Analytic sample density
+//
+// The grid triangles of a surface P(u, v) over cells hu x hv stay within
+//     (Muu hu^2 + 2 Muv hu hv + Mvv hv^2) / 8
+// of it, where Muu, Muv and Mvv bound the second derivatives (Filip,
+// Magedson and Markot). For a bicubic patch these follow from the control
+// net: |Puu| <= 6 max |second difference along u|, |Pvv| likewise along v,
+// and |Puv| <= 9 max |mixed difference|. So each patch gets the smallest
+// grid that keeps that bound within a chord tolerance.
+//
+// Neighbouring patches can then disagree on how many samples their shared
+// side gets. Each side uses the larger of the two counts, and the patch
+// stitches its boundary ring to its own grid inside, so both patches sample
+// the side at the same parameters.
+//****************************************************
+
+// Uniform mode with per-patch grids from the control net bounds; stepSize is
+// then the chord tolerance
+extern bool analyticDensity;
+
+// Cells along u (counts[0]) and v (counts[1]) that keep the patch's grid
+// triangles within tolerance of it
+void analyticCounts(const BPatch& patch, float tolerance, unsigned int counts[2]);
+
+// Tessellates patch as a grid of counts[0] x counts[1] cells whose sides have
+// edges[s] segments, in grid order (v = 0, u = 1, v = 1, u = 0). Each side
+// must have at least as many segments as the grid has cells along it.
+void densityTraversal(const BPatch& patch, const unsigned int counts[2], const unsigned int edges[4],
+	Mesh& mesh);
+
+#endif
@@ -0,0 +1,59 @@
+#include "FrameBudget.h"
+
+#include <algorithm>
+#include <cmath>
+
+//****************************************************
+// Global Variables
+//****************************************************
+double targetFrameSeconds = 0.0;
+
+namespace {
+
+// Frames averaged per decision
+const int groupFrames = 4;
+
+// The band around the target that needs no correction, and where in it a
+// correction aims
+const double underBudget = 0.6;
+const double overBudget = 1.1;
+const double aim = 0.85;
+
+// Largest change of tolerance per correction
+const float maxFactor = 2.0;
+
+}
+
+FrameBudget::FrameBudget() : lastAverage(0.0) {
+	reset();
+}
+
+void FrameBudget::reset() {
+	sum = 0.0;
+	samples = 0;
+	skip = 1;
+	settled = false;
+}
+
+float FrameBudget::update(double seconds, float exponent) {
+	if (skip > 0) {
+		skip--;
+		return 1.0;
+	}
+	sum += seconds;
+	if (++samples < groupFrames) {
+		return 1.0;
+	}
+
+	lastAverage = sum / samples;
+	sum = 0.0;
+	samples = 0;
+	settled = true;
+	if (lastAverage >= underBudget * targetFrameSeconds
+		&& lastAverage <= overBudget * targetFrameSeconds) {
+		return 1.0;
+	}
+
+	float factor = pow(lastAverage / (aim * targetFrameSeconds), 1.0 / exponent);
+	return std::min(std::max(factor, 1.0f / maxFactor), maxFactor);
+}
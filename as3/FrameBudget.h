@@ -0,0 +1,47 @@
+#ifndef FRAMEBUDGET_H
+#define FRAMEBUDGET_H
+
+//****************************************************
+// Frame-time budget
+//
+// Picks the tessellation density from measured frame times instead of a
+// fixed step size. Frames are averaged in small groups; a group whose
+// average leaves the band [underBudget, overBudget] x target scales the
+// tolerance so the next mesh should land in the middle of the band. The
+// band is wide enough that one correction doesn't overshoot out of it
+// again, so the density settles instead of oscillating.
+//****************************************************
+
+// Frame time to aim for in seconds, from --target-ms; 0 for none
+extern double targetFrameSeconds;
+
+class FrameBudget {
+public:
+	FrameBudget();
+
+	// Feeds the time one frame took with the current mesh. Returns the
+	// factor to scale the tolerance (step size, flatness or pixel error) by:
+	// 1 to keep it, above 1 for a coarser mesh, below 1 for a finer one.
+	// Triangle counts go as tolerance^-exponent (2 for uniform steps, 1 for
+	// adaptive tolerances).
+	float update(double seconds, float exponent);
+
+	// Starts measuring afresh, for a new mesh; its first frame (the upload)
+	// doesn't count
+	void reset();
+
+	// Whether the current mesh still needs frames measured before the
+	// budget can judge it
+	bool measuring() const { return !settled; }
+
+	// Average frame time of the last group judged
+	double average() const { return lastAverage; }
+
+private:
+	double sum, lastAverage;
+	int samples;
+	int skip;
+	bool settled;
+};
+
+#endif
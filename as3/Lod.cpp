@@ -0,0 +1,171 @@
+#include "Lod.h"
+#include "Culling.h"
+#include "Tessellator.h"
+
+#include <algorithm>
+#include <iostream>
+
+//****************************************************
+// Global Variables
+//****************************************************
+int lodLevels = 0;
+float lodCellPixels = 8.0;
+
+namespace {
+
+// Rounds grid index i to the nearest multiple of ratio
+inline unsigned int snap(unsigned int i, unsigned int ratio) {
+	return (i + ratio / 2) / ratio * ratio;
+}
+
+}
+
+//****************************************************
+// Building
+//****************************************************
+
+bool LodCache::build(Mesh& mesh) {
+	levels = lodLevels;
+	step = stepSize;
+	unsigned int unit = 1u << (levels - 1);
+	cells = (uniformSteps() + unit - 1) / unit * unit;
+
+	firstVertex.resize((size_t) numPatches * levels);
+	size_t total = 0;
+	for (int i = 0; i < numPatches; i++) {
+		for (int k = 0; k < levels; k++) {
+			size_t n = cells >> k;
+			firstVertex[(size_t) i * levels + k] = total;
+			total += (n + 1) * (n + 1);
+		}
+	}
+	if (total > 0xffffffffu) {
+		std::cerr << "Too many vertices for " << levels << " levels of detail" << std::endl;
+		levels = 0;
+		return false;
+	}
+
+	std::vector<BasisTable> tables(levels);
+	for (int k = 0; k < levels; k++) {
+		unsigned int n = cells >> k;
+		std::vector<float> samples(n + 1);
+		for (unsigned int j = 0; j <= n; j++) {
+			samples[j] = (float) j / n;
+		}
+		fillBasisTable(tables[k], samples);
+	}
+
+	// Each level is one curveTraversal() grid, whose vertex (i, j) at u
+	// sample i and v sample j is i * (n + 1) + j
+	mesh.clear();
+	mesh.vertices.resize(total);
+	std::vector<Mesh> scratch(tessellationPool->size());
+	tessellationPool->parallelFor(numPatches, [&](int i, int w) {
+		for (int k = 0; k < levels; k++) {
+			Mesh& grid = scratch[w];
+			grid.clear();
+			curveTraversal(scenePatches[i], tables[k], 0, tables[k].samples.size(), grid);
+			std::copy(grid.vertices.begin(), grid.vertices.end(),
+				mesh.vertices.begin() + firstVertex[(size_t) i * levels + k]);
+		}
+	});
+
+	findNeighbours();
+	chosen.clear();
+	return true;
+}
+
+// Keeps the patch on the other side of each side, for snapping
+void LodCache::findNeighbours() {
+	matchPatchSides(scenePatches, numPatches, neighbours);
+	for (size_t s = 0; s < neighbours.size(); s++) {
+		if (neighbours[s] >= 0) {
+			neighbours[s] /= 4;
+		}
+	}
+}
+
+//****************************************************
+// Selection
+//****************************************************
+
+bool LodCache::select(float pixelsPerUnit, Mesh& mesh) {
+	bool changed = chosen.size() != (size_t) numPatches;
+	chosen.resize(numPatches);
+	counts.assign(levels, 0);
+	for (int i = 0; i < numPatches; i++) {
+		const PatchBounds& bounds = patchBounds[i];
+		float pixels = distancePoint(bounds.min, bounds.max) * pixelsPerUnit;
+
+		int k = levels - 1;
+		while (k > 0 && pixels / (cells >> k) > lodCellPixels) {
+			k--;
+		}
+		changed = changed || chosen[i] != k;
+		chosen[i] = k;
+		counts[k]++;
+	}
+	if (!changed) {
+		return false;
+	}
+
+	mesh.indices.clear();
+	mesh.patchStarts.resize(numPatches + 1);
+	for (int i = 0; i < numPatches; i++) {
+		mesh.patchStarts[i] = mesh.indices.size();
+		addPatchIndices(i, mesh);
+	}
+	mesh.patchStarts[numPatches] = mesh.indices.size();
+	return true;
+}
+
+// Indexes the patch's grid at its chosen level as addGridIndices() does,
+// except that each boundary vertex is snapped to the samples of the coarser
+// of the two patches on that side. Cells next to a coarser neighbour then
+// fan out from its samples, and the triangles that collapse are dropped.
+void LodCache::addPatchIndices(size_t patch, Mesh& mesh) const {
+	int level = chosen[patch];
+	unsigned int n = cells >> level;
+	unsigned int base = firstVertex[patch * levels + level];
+
+	unsigned int ratio[4];
+	for (int side = 0; side < 4; side++) {
+		int neighbour = neighbours[patch * 4 + side];
+		ratio[side] = 1;
+		if (neighbour >= 0 && chosen[neighbour] > level) {
+			ratio[side] = 1u << (chosen[neighbour] - level);
+		}
+	}
+
+	auto vertex = [&](unsigned int i, unsigned int j) {
+		if (j == 0) {
+			i = snap(i, ratio[0]);
+		} else if (j == n) {
+			i = snap(i, ratio[2]);
+		} else if (i == 0) {
+			j = snap(j, ratio[3]);
+		} else if (i == n) {
+			j = snap(j, ratio[1]);
+		}
+		return base + i * (n + 1) + j;
+	};
+	auto triangle = [&](unsigned int a, unsigned int b, unsigned int c) {
+		if (a != b && b != c && a != c) {
+			mesh.indices.push_back(a);
+			mesh.indices.push_back(b);
+			mesh.indices.push_back(c);
+		}
+	};
+
+	for (unsigned int i = 0; i < n; i++) {
+		for (unsigned int j = 0; j < n; j++) {
+			unsigned int i1 = vertex(i, j);			// (old_u, old_v)
+			unsigned int i2 = vertex(i + 1, j);		// (new_u, old_v)
+			unsigned int i3 = vertex(i, j + 1);		// (old_u, new_v)
+			unsigned int i4 = vertex(i + 1, j + 1);	// (new_u, new_v)
+
+			triangle(i2, i4, i1);
+			triangle(i4, i3, i1);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+
+#include "Bezier.h"
+
+//****************************************************
+// Level-of-detail cache for uniform tessellation
+//
+// Every patch is evaluated once at each level: level k has n >> k cells a
+// side, where n is uniformSteps() rounded up to a multiple of
+// 2^(levels - 1), so each level's samples are a subset of the finer
+// ones. Choosing levels per frame then only rewrites the index buffer.
+//
+// Where two patches at different levels meet, the finer one snaps the
+// samples of that edge to the coarser one's, so both sides use the same
+// boundary vertices and no cracks open between them.
+//****************************************************
+
+// Number of levels the viewer keeps; 0 or 1 turns the cache off
+extern int lodLevels;
+
+// Patches get the coarsest level whose cells cover at most this many
+// pixels across
+extern float lodCellPixels;
+
+class LodCache {
+public:
+	LodCache() : levels(0), step(0.0) {}
+
+	// Whether mesh holds this cache's levels for the current stepSize
+	bool current() const { return levels == lodLevels && step == stepSize; }
+
+	// Evaluates every level of the scene into mesh.vertices and finds which
+	// patch edges are shared, in parallel on tessellationPool. Returns false
+	// (after printing why) if the levels don't fit 32-bit indices.
+	bool build(Mesh& mesh);
+
+	// Picks each patch's level for a view that draws one model unit
+	// pixelsPerUnit pixels wide, using patchBounds for the patch sizes, and
+	// rewrites mesh.indices and mesh.patchStarts if any level changed.
+	// Returns whether they did.
+	bool select(float pixelsPerUnit, Mesh& mesh);
+
+	// Patches at each level after the last select(), finest first
+	const std::vector<size_t>& levelCounts() const { return counts; }
+
+private:
+	void findNeighbours();
+	void addPatchIndices(size_t patch, Mesh& mesh) const;
+
+	int levels;
+	float step;
+	unsigned int cells;						// of the finest level
+
+	std::vector<unsigned int> firstVertex;	// per patch and level
+	std::vector<int> neighbours;			// per patch and side, -1 for none
+	std::vector<unsigned char> chosen;		// level per patch
+	std::vector<size_t> counts;
+};
+
+#endif
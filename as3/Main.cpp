@@ -1,14 +1,14 @@
 
 #include <vector>
+#include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cmath>
+#include <cstddef>
+#include <thread>
+#include <atomic>
 
 #ifdef _WIN32
 #include <windows.h>
-#else
-#include <sys/time.h>
 #endif
 
 #ifdef OSX
@@ -19,16 +19,22 @@
 #include <GL/glu.h>
 #endif
 
-#ifdef _WIN32
-static DWORD lastTime;
-#else
-static struct timeval lastTime;
-#endif
+#include "Bezier.h"
+#include "Tessellator.h"
+#include "Batch.h"
+#include "Scene.h"
+#include "Culling.h"
+#include "Lod.h"
+#include "Offscreen.h"
+#include "Profile.h"
+#include "FrameBudget.h"
+#include "Density.h"
 
 #include <time.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #define PI 3.14159265  // Should be used from mathlib
 inline float sqr(float x) { return x*x; }
@@ -44,42 +50,95 @@ public:
 	int w, h; // width and height
 };
 
-class Point {
-public:
-	GLfloat x, y, z;
-};
-
-class BCurve {
-public:
-	Point p1, p2, p3, p4;
-};
-
-class BPatch {
-public:
-	BCurve c1, c2, c3, c4;
-};
-
-class Triangle {
-public:
-	Point p1, p2, p3, pc1, pc2, pc3, n1, n2, n3;
-};
-
-class Tuple {
+// Where a frame's time went, for --offscreen
+class FrameTimes {
 public:
-	Point p1, p2;
+	double tessellate;	// CPU tessellation (updateMesh())
+	double submit;		// issuing GL commands, including uploads
+	double total;		// up to the frame being finished (glFinish())
 };
-
-
 //****************************************************
 // Global Variables
 //****************************************************
 Viewport	viewport;
 
-GLfloat stepSize;
-std::vector<BPatch*> bPatches;
-int numPatches;
-
-bool adaptive = false;
+// Retained tessellation, rebuilt only when its inputs change
+Mesh mesh;
+bool meshDirty = true;
+GLfloat meshStepSize = 0.0;
+bool meshAdaptive = false;
+bool meshAnalytic = false;
+bool meshForward = false;
+bool meshSimd = false;
+
+// Patches that may show this frame, and those the mesh was built from
+std::vector<unsigned char> patchVisible;
+std::vector<unsigned char> meshPatches;
+CullStats cullStats;
+
+// Levels of detail for uniform mode (--lod), kept in mesh while in use
+LodCache lodCache;
+bool meshLod = false;
+
+// Meshes are built by a job into backMesh and then swapped with mesh. The
+// window runs jobs on meshThread and goes on drawing the previous mesh
+// meanwhile; offscreen runs them inline.
+bool backgroundTessellation = false;
+std::thread meshThread;
+std::atomic<bool> jobDone(true);
+bool jobFailed = false;
+double jobSeconds = 0.0;
+Mesh backMesh;
+bool backLod = false;
+bool backProgressive = false;
+std::vector<unsigned char> backPatches;
+const int jobPollInterval = 10;		// ms
+
+// The window refines its first mesh progressively with background
+// tessellation (see updateMesh()); mesh is one of the coarser levels until
+// meshProgressive clears
+bool progressiveRefinement = false;
+bool meshProgressive = false;
+const GLfloat coarsestStep = 1.0;		// two triangles per patch
+
+// Tessellation settings as the keys last set them
+GLfloat requestedStepSize = 0.0;
+bool requestedAdaptive = false;
+bool requestedAnalytic = false;
+bool requestedViewDependent = false;
+GLfloat requestedPixelError = 1.0;
+const GLfloat stepFactor = 1.5;		// per [ or ] press
+const GLfloat finestStep = 0.001;
+const GLfloat finestPixelError = 0.1;
+const GLfloat coarsestPixelError = 100.0;
+
+// Adjusts the requested tolerance to --target-ms, measuring the meshes
+// built with budgetTolerance
+FrameBudget frameBudget;
+GLfloat budgetTolerance = 0.0;
+bool budgetAdaptive = false;
+bool budgetAnalytic = false;
+
+// Buffer objects holding the uploaded mesh (GL 1.5); without them the mesh
+// is drawn from client-side vertex arrays instead
+bool useBuffers = false;
+bool meshUploaded = false;
+bool indicesUploaded = false;
+GLuint vertexBuffer = 0;
+GLuint indexBuffer = 0;
+
+// Statistics overlay (i key)
+bool showStats = false;
+
+// The window only redraws when something it shows changes. While the model
+// turns (r key), frames are paced to frameInterval by a GLUT timer that is
+// armed after each frame, so a slow frame delays the next one instead of
+// queueing them up.
+bool animating = false;
+bool frameTimerArmed = false;
+double animationTime = 0.0;				// currentTime() the turn was last advanced to
+const int frameInterval = 16;			// ms, for about 60 frames a second
+const GLfloat animationSpeed = 45.0;	// degrees a second about y
 
 // Wired Mode or Filled Mode
 bool wired = false;
@@ -138,755 +197,415 @@ void initScene(){
 
 	glEnable(GL_LIGHTING);
 	glEnable(GL_LIGHT0);
-}
 
-//*********************************************w
-// Helper Methods
-//********************************************* 
-
-Point multiplyPoint(GLfloat s, Point p){
-	Point r;
-	r.x = p.x * s;
-	r.y = p.y * s;
-	r.z = p.z * s;
-	return r;
-}
-
-Point addPoint(Point p1, Point p2){
-	Point r;
-	r.x = p1.x + p2.x;
-	r.y = p1.y + p2.y;
-	r.z = p1.z + p2.z;
-	return r;
-}
-
-Point subtractPoint(Point p1, Point p2){
-	Point r;
-	r.x = p1.x - p2.x;
-	r.y = p1.y - p2.y;
-	r.z = p1.z - p2.z;
-	return r;
-}
-
-Point normalize(Point p){
-	Point r;
-	GLfloat len = sqrt(pow(p.x, 2.0) + pow(p.y, 2.0) + pow(p.z, 2.0));
-	r.x = p.x / len;
-	r.y = p.y / len;
-	r.z = p.z / len;
-	return r;
-}
-
-Point crossProduct(Point p1, Point p2){
-	Point r;
-	r.x = p1.y * p2.z - p1.z * p2.y;
-	r.y = p1.z * p2.x - p1.x * p2.z;
-	r.z = p1.x * p2.y - p1.y * p2.x;
-	return r;
+#ifdef GL_VERSION_1_5
+	const char* version = (const char*) glGetString(GL_VERSION);
+	int major = 0, minor = 0;
+	if (version && sscanf(version, "%d.%d", &major, &minor) == 2) {
+		useBuffers = major > 1 || (major == 1 && minor >= 5);
+	}
+#endif
 }
 
-Point getNormal(Point p1, Point p2, Point p3){
-	return crossProduct(subtractPoint(p3, p1), subtractPoint(p2, p1));
-}
+//****************************************************
+// Retained mesh
+//****************************************************
 
-Point midPoint(Point p1, Point p2) {
-	Point r;
-	r.x = (p1.x + p2.x)/2.0;
-	r.y = (p1.y + p2.y)/2.0;
-	r.z = (p1.z + p2.z)/2.0;
-	return r;
+// Builds the next mesh into backMesh: the scene's levels of detail if lod,
+// its tessellation of backPatches otherwise
+void runMeshJob(bool lod) {
+	double start = currentTime();
+	jobFailed = false;
+	if (lod) {
+		jobFailed = !lodCache.build(backMesh);
+	} else {
+		tessellate(backMesh, backPatches.empty() ? NULL : &backPatches[0]);
+	}
+	jobSeconds = currentTime() - start;
+	jobDone = true;
 }
 
-GLfloat distancePoint(Point p1, Point p2) {
-	return sqrt(pow(p1.x-p2.x, 2.0) + pow(p1.y-p2.y, 2.0) + pow(p1.z-p2.z, 2.0));
+// Posts a redisplay once the background job is done, so the next frame
+// swaps its mesh in
+void pollMeshJob(int value) {
+	if (jobDone) {
+		glutPostRedisplay();
+	} else {
+		glutTimerFunc(jobPollInterval, pollMeshJob, 0);
+	}
 }
 
-Tuple bernstein(GLfloat u, BCurve curve){
-	Point a, b, c, d, e, p, pd;
-	Tuple output;
-
-	a = addPoint(multiplyPoint((1.0-u), curve.p1), multiplyPoint(u, curve.p2));
-	b = addPoint(multiplyPoint((1.0-u), curve.p2), multiplyPoint(u, curve.p3));
-	c = addPoint(multiplyPoint((1.0-u), curve.p3), multiplyPoint(u, curve.p4));
-
-	d = addPoint(multiplyPoint((1.0-u), a), multiplyPoint(u, b));
-	e = addPoint(multiplyPoint((1.0-u), b), multiplyPoint(u, c));
-
-	p = addPoint(multiplyPoint((1.0-u), d), multiplyPoint(u, e));
-	pd = multiplyPoint(3.0, subtractPoint(e, d));
-
-	output.p1 = p;
-	output.p2 = pd;
-	return output;
+void startMeshJob(bool lod, bool background) {
+	backLod = lod;
+	backPatches = patchVisible;
+	jobDone = false;
+	meshDirty = false;
+	if (!background) {
+		runMeshJob(lod);
+		return;
+	}
+	meshThread = std::thread(runMeshJob, lod);
+	glutTimerFunc(jobPollInterval, pollMeshJob, 0);
 }
 
-Tuple patchPoint(GLfloat u, GLfloat v, BPatch patch) {
-	BCurve vcurve, ucurve;
-	Point p, dPdv, dPdu, n;
-
-	BCurve hc1, hc2, hc3, hc4;
-
-	hc1.p1 = patch.c1.p1;
-	hc1.p2 = patch.c2.p1;
-	hc1.p3 = patch.c3.p1;
-	hc1.p4 = patch.c4.p1;
-
-	hc2.p1 = patch.c1.p2;
-	hc2.p2 = patch.c2.p2;
-	hc2.p3 = patch.c3.p2;
-	hc2.p4 = patch.c4.p2;
-
-	hc3.p1 = patch.c1.p3;
-	hc3.p2 = patch.c2.p3;
-	hc3.p3 = patch.c3.p3;
-	hc3.p4 = patch.c4.p3;
-
-	hc4.p1 = patch.c1.p4;
-	hc4.p2 = patch.c2.p4;
-	hc4.p3 = patch.c3.p4;
-	hc4.p4 = patch.c4.p4;
-
-	vcurve.p1 = bernstein(u, patch.c1).p1;
-	vcurve.p2 = bernstein(u, patch.c2).p1;
-	vcurve.p3 = bernstein(u, patch.c3).p1;
-	vcurve.p4 = bernstein(u, patch.c4).p1;
-
-	ucurve.p1 = bernstein(v, hc1).p1;
-	ucurve.p2 = bernstein(v, hc2).p1;
-	ucurve.p3 = bernstein(v, hc3).p1;
-	ucurve.p4 = bernstein(v, hc4).p1;
-
-	Tuple temp1 = bernstein(v, vcurve);
-	Tuple temp2 = bernstein(u, ucurve);
-	p = temp1.p1;
-	dPdv = temp1.p2;
-	dPdu = temp2.p2;
-
-	n = crossProduct(dPdu, dPdv);
-	Tuple output;
-	output.p1 = p;
-	output.p2 = n;
-	return output;
+void waitForMeshJob() {
+	if (meshThread.joinable()) {
+		meshThread.join();
+	}
 }
 
-void drawPolygon(Tuple t1, Tuple t2, Tuple t3, Tuple t4){
-	glBegin(GL_POLYGON);
-	glNormal3f(t1.p2.x, t1.p2.y, t1.p2.z);
-	glVertex3f(t1.p1.x, t1.p1.y, t1.p1.z);
-
-	glNormal3f(t2.p2.x, t2.p2.y, t2.p2.z);
-	glVertex3f(t2.p1.x, t2.p1.y, t2.p1.z);
-
-	glNormal3f(t4.p2.x, t4.p2.y, t4.p2.z);
-	glVertex3f(t4.p1.x, t4.p1.y, t4.p1.z);
-
-	glNormal3f(t3.p2.x, t3.p2.y, t3.p2.z);
-	glVertex3f(t3.p1.x, t3.p1.y, t3.p1.z);
-	glEnd();
+// Swaps the finished job's mesh in, unless it failed
+void finishMeshJob() {
+	waitForMeshJob();
+	if (jobFailed) {
+		lodLevels = 0;
+		return;
+	}
+	std::swap(mesh, backMesh);
+	meshLod = backLod;
+	meshProgressive = !backLod && backProgressive;
+	meshPatches = backPatches;
+	meshStepSize = stepSize;
+	meshAdaptive = adaptive;
+	meshAnalytic = analyticDensity;
+	meshForward = forwardDifferencing;
+	meshSimd = simdEvaluation;
+	meshUploaded = false;
+	indicesUploaded = false;
+
+	double elapsed = jobSeconds * 1000.0;
+	if (meshLod) {
+		std::cout << "Built " << lodLevels << " levels of detail (" << mesh.vertices.size()
+			<< " vertices) in " << elapsed << " ms" << std::endl;
+	} else {
+		std::cout << "Tessellated " << mesh.indices.size() / 3 << " triangles in "
+			<< elapsed << " ms on " << tessellationPool->size() << " threads" << std::endl;
+	}
 }
 
-void drawTriangle(Triangle tri){
-	glBegin(GL_POLYGON);
-	glNormal3f(tri.n1.x, tri.n1.y, tri.n1.z);
-	glVertex3f(tri.p1.x, tri.p1.y, tri.p1.z);
-
-	glNormal3f(tri.n2.x, tri.n2.y, tri.n2.z);
-	glVertex3f(tri.p2.x, tri.p2.y, tri.p2.z);
+// The cache is evaluated once per step size; after that, zooming only
+// re-indexes it
+void updateLodMesh() {
+	if (!meshLod || !lodCache.current()) {
+		startMeshJob(true, backgroundTessellation);
+		if (!jobDone) {
+			return;
+		}
+		finishMeshJob();
+		if (jobFailed) {
+			return;
+		}
+	}
 
-	glNormal3f(tri.n3.x, tri.n3.y, tri.n3.z);
-	glVertex3f(tri.p3.x, tri.p3.y, tri.p3.z);
-	glEnd();
+	float pixelsPerUnit = fabs(scaleValue)
+		* std::max(viewport.w / (2.0f * maxX), viewport.h / (2.0f * maxY));
+	if (lodCache.select(pixelsPerUnit, mesh)) {
+		std::cout << "Levels of detail:";
+		for (size_t k = 0; k < lodCache.levelCounts().size(); k++) {
+			std::cout << " " << lodCache.levelCounts()[k];
+		}
+		std::cout << " patches, " << mesh.indices.size() / 3 << " triangles" << std::endl;
+		indicesUploaded = false;
+	}
 }
 
-void subdivideTriangle(Triangle tri, BPatch patch) {
-	Triangle* t1 = new Triangle;
-	Triangle* t2 = new Triangle;
-	Triangle* t3 = new Triangle;
-	Triangle* t4 = new Triangle;
-
-	bool edge1 = false;
-	bool edge2 = false;
-	bool edge3 = false;
-
-	Point* midPoint1 = new Point;
-	Point* midPoint2 = new Point;
-	Point* midPoint3 = new Point;
-
-	Point* midPara1 = new Point;
-	Point* midPara2 = new Point;
-	Point* midPara3 = new Point;
-
-	Point* midReal1 = new Point;
-	Point* midReal2 = new Point;
-	Point* midReal3 = new Point;
-
-	Point* midNorm1 = new Point;
-	Point* midNorm2 = new Point;
-	Point* midNorm3 = new Point;
-
-	*midPoint1 = midPoint(tri.p1, tri.p2);
-	*midPoint2 = midPoint(tri.p2, tri.p3);
-	*midPoint3 = midPoint(tri.p1, tri.p3);
+// Keeps the mesh in step with the settings and the view. In the window the
+// work runs on meshThread while the previous mesh goes on being drawn, and
+// the frame after it finishes swaps the new one in; the tessellation
+// globals only take the requested settings between jobs, since jobs read
+// them.
+void updateMesh() {
+	if (meshThread.joinable()) {
+		if (!jobDone) {
+			return;
+		}
+		finishMeshJob();
+	}
 
-	*midPara1 = midPoint(tri.pc1, tri.pc2);
-	*midPara2 = midPoint(tri.pc2, tri.pc3);
-	*midPara3 = midPoint(tri.pc1, tri.pc3);
+	stepSize = requestedStepSize;
+	adaptive = requestedAdaptive;
+	analyticDensity = requestedAnalytic;
+	if (viewDependent != requestedViewDependent) {
+		viewDependent = requestedViewDependent;
+		meshDirty = true;
+	}
 
-	Tuple temp1 = patchPoint(midPara1->x, midPara1->y, patch);
-	Tuple temp2 = patchPoint(midPara2->x, midPara2->y, patch);
-	Tuple temp3 = patchPoint(midPara3->x, midPara3->y, patch);
+	if (!adaptive && !analyticDensity && lodLevels > 1) {
+		updateLodMesh();
+		return;
+	}
 
-	*midReal1 = temp1.p1;
-	*midReal2 = temp2.p1;
-	*midReal3 = temp3.p1;
+	// A view-dependent mesh follows the camera; translation doesn't change
+	// an orthographic projection's scale, so only zoom, rotation and the
+	// window size count
+	if (adaptive && viewDependent) {
+		AdaptiveView view = tessellationView;
+		view.pixelError = requestedPixelError;
+		view.orthographic(scaleValue, xRot, yRot, maxX, maxY, viewport.w, viewport.h);
+		if (view != tessellationView) {
+			tessellationView = view;
+			meshDirty = true;
+		}
+	}
 
-	*midNorm1 = temp1.p2;	
-	*midNorm2 = temp2.p2;
-	*midNorm3 = temp3.p2;
+	// Patches culled when the mesh was built have no triangles
+	for (size_t i = 0; i < patchVisible.size() && !meshDirty; i++) {
+		if (patchVisible[i] && !meshPatches[i]) {
+			meshDirty = true;
+		}
+	}
 
-	if (distancePoint(*midReal1, *midPoint1) > stepSize) {
-		edge1 = true;
+	if (!meshDirty && !meshLod && meshStepSize == stepSize && meshAdaptive == adaptive
+		&& meshAnalytic == analyticDensity
+		&& meshForward == forwardDifferencing && meshSimd == simdEvaluation) {
+		return;
 	}
-	if (distancePoint(*midReal2, *midPoint2) > stepSize) {
-		edge2 = true;
+
+	// Progressive refinement: with nothing to draw yet, the window first
+	// makes two triangles per patch inline, then refines in the background
+	// through uniform levels whose steps halve down to stepSize. Each level
+	// has about a quarter of the next one's triangles, so the whole ladder
+	// costs about a third more than the final mesh alone. Adaptive and
+	// analytic modes go from the coarsest level straight to the final mesh.
+	// The refinement isn't sliced into per-frame time budgets: each level is
+	// one whole job, and frames stay responsive only because jobs run on
+	// meshThread, so it needs backgroundTessellation.
+	backProgressive = false;
+	bool progressive = progressiveRefinement && backgroundTessellation;
+	if (progressive && meshStepSize == 0.0
+		&& (adaptive || analyticDensity || stepSize < coarsestStep)) {
+		stepSize = coarsestStep;
+		adaptive = false;
+		analyticDensity = false;
+		backProgressive = true;
+		startMeshJob(false, false);
+		finishMeshJob();
+		glutPostRedisplay();
+		return;
 	}
-	if (distancePoint(*midReal3, *midPoint3) > stepSize) {
-		edge3 = true;
+	if (progressive && meshProgressive && !adaptive && !analyticDensity) {
+		GLfloat level = stepSize;
+		while (level * 2.0f <= meshStepSize / 2.0f) {
+			level *= 2.0f;
+		}
+		backProgressive = level != stepSize;
+		stepSize = level;
 	}
 
-	if (edge1 && edge2 && edge3) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = *midReal1;
-		t1->p3 = *midReal3;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = *midPara1;
-		t1->pc3 = *midPara3;
-
-		t1->n1 = tri.n1;
-		t1->n2 = *midNorm1;
-		t1->n3 = *midNorm3;
-
-		//New Triangle 2
-		t2->p1 = *midReal1;
-		t2->p2 = tri.p2;
-		t2->p3 = *midReal2;
-
-		t2->pc1 = *midPara1;
-		t2->pc2 = tri.pc2;
-		t2->pc3 = *midPara2;
-
-		t2->n1 = *midNorm1;
-		t2->n2 = tri.n2;
-		t2->n3 = *midNorm2;
-
-		//New Triangle 3
-		t3->p1 = *midReal3;
-		t3->p2 = *midReal2;
-		t3->p3 = tri.p3;
-
-		t3->pc1 = *midPara3;
-		t3->pc2 = *midPara2;
-		t3->pc3 = tri.pc3;
-
-		t3->n1 = *midNorm3;
-		t3->n2 = *midNorm2;
-		t3->n3 = tri.n3;
-
-		//New Triangle 4
-		t4->p1 = *midReal1;
-		t4->p2 = *midReal2;
-		t4->p3 = *midReal3;
-
-		t4->pc1 = *midPara1;
-		t4->pc2 = *midPara2;
-		t4->pc3 = *midPara3;
-
-		t4->n1 = *midNorm1;
-		t4->n2 = *midNorm2;
-		t4->n3 = *midNorm3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-		subdivideTriangle(*t3, patch);
-		subdivideTriangle(*t4, patch);
-
-	} else if (edge1 && edge3) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = *midReal1;
-		t1->p3 = *midReal3;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = *midPara1;
-		t1->pc3 = *midPara3;
-
-		t1->n1 = tri.n1;
-		t1->n2 = *midNorm1;
-		t1->n3 = *midNorm3;
-
-		//New Triangle 2
-		t2->p1 = *midReal3;
-		t2->p2 = *midReal1;
-		t2->p3 = tri.p3;
-
-		t2->pc1 = *midPara3;
-		t2->pc2 = *midPara1;
-		t2->pc3 = tri.pc3;
-
-		t2->n1 = *midNorm3;
-		t2->n2 = *midNorm1;
-		t2->n3 = tri.n3;
-
-		//New Triangle 3
-		t3->p1 = *midReal1;
-		t3->p2 = tri.p2;
-		t3->p3 = tri.p3;
-
-		t3->pc1 = *midPara1;
-		t3->pc2 = tri.pc2;
-		t3->pc3 = tri.pc3;
-
-		t3->n1 = *midNorm1;
-		t3->n2 = tri.n2;
-		t3->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-		subdivideTriangle(*t3, patch);
-
-	} else if (edge2 && edge3) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = tri.p2;
-		t1->p3 = *midReal3;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = tri.pc2;
-		t1->pc3 = *midPara3;
-
-		t1->n1 = tri.n1;
-		t1->n2 = tri.n2;
-		t1->n3 = *midNorm3;
-
-		//New Triangle 2
-		t2->p1 = tri.p2;
-		t2->p2 = *midReal2;
-		t2->p3 = *midReal3;
-
-		t2->pc1 = tri.pc2;
-		t2->pc2 = *midPara2;
-		t2->pc3 = *midPara3;
-
-		t2->n1 = tri.n2;
-		t2->n2 = *midNorm2;
-		t2->n3 = *midNorm3;
-
-		//New Triangle 3
-		t3->p1 = *midReal3;
-		t3->p2 = *midReal2;
-		t3->p3 = tri.p3;
-
-		t3->pc1 = *midPara3;
-		t3->pc2 = *midPara2;
-		t3->pc3 = tri.pc3;
-
-		t3->n1 = *midNorm3;
-		t3->n2 = *midNorm2;
-		t3->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-		subdivideTriangle(*t3, patch);
-
-	} else if (edge1 && edge2) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = *midReal1;
-		t1->p3 = *midReal2;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = *midPara1;
-		t1->pc3 = *midPara2;
-
-		t1->n1 = tri.n1;
-		t1->n2 = *midNorm1;
-		t1->n3 = *midNorm2;
-
-		//New Triangle 2
-		t2->p1 = *midReal1;
-		t2->p2 = tri.p2;
-		t2->p3 = *midReal2;
-
-		t2->pc1 = *midPara1;
-		t2->pc2 = tri.pc2;
-		t2->pc3 = *midPara2;
-
-		t2->n1 = *midNorm1;
-		t2->n2 = tri.n2;
-		t2->n3 = *midNorm2;
-
-		//New Triangle 3
-		t3->p1 = tri.p1;
-		t3->p2 = *midReal2;
-		t3->p3 = tri.p3;
-
-		t3->pc1 = tri.pc1;
-		t3->pc2 = *midPara2;
-		t3->pc3 = tri.pc3;
-
-		t3->n1 = tri.n1;
-		t3->n2 = *midNorm2;
-		t3->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-		subdivideTriangle(*t3, patch);
-
-	} else if (edge1) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = *midReal1;
-		t1->p3 = tri.p3;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = *midPara1;
-		t1->pc3 = tri.pc3;
-
-		t1->n1 = tri.n1;
-		t1->n2 = *midNorm1;
-		t1->n3 = tri.n3;
-
-		//New Triangle 2
-		t2->p1 = *midReal1;
-		t2->p2 = tri.p2;
-		t2->p3 = tri.p3;
-
-		t2->pc1 = *midPara1;
-		t2->pc2 = tri.pc2;
-		t2->pc3 = tri.pc3;
-
-		t2->n1 = *midNorm1;
-		t2->n2 = tri.n2;
-		t2->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-
-	} else if (edge2) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = tri.p2;
-		t1->p3 = *midReal2;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = tri.pc2;
-		t1->pc3 = *midPara2;
-
-		t1->n1 = tri.n1;
-		t1->n2 = tri.n2;
-		t1->n3 = *midNorm2;
-
-		//New Triangle 2
-		t2->p1 = tri.p1;
-		t2->p2 = *midReal2;
-		t2->p3 = tri.p3;
-
-		t2->pc1 = tri.pc1;
-		t2->pc2 = *midPara2;
-		t2->pc3 = tri.pc3;
-
-		t2->n1 = tri.n1;
-		t2->n2 = *midNorm2;
-		t2->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-
-	} else if (edge3) {
-		//New Triangle 1
-		t1->p1 = tri.p1;
-		t1->p2 = tri.p2;
-		t1->p3 = *midReal3;
-
-		t1->pc1 = tri.pc1;
-		t1->pc2 = tri.pc2;
-		t1->pc3 = *midPara3; 
-
-		t1->n1 = tri.n1;
-		t1->n2 = tri.n2;
-		t1->n3 = *midNorm3;
-
-		//New Triangle 2
-		t2->p1 = *midReal3;
-		t2->p2 = tri.p2;
-		t2->p3 = tri.p3;
-
-		t2->pc1 = *midPara3;
-		t2->pc2 = tri.pc2;
-		t2->pc3 = tri.pc3;
-
-		t2->n1 = *midNorm3;
-		t2->n2 = tri.n2;
-		t2->n3 = tri.n3;
-
-		subdivideTriangle(*t1, patch);
-		subdivideTriangle(*t2, patch);
-
-	} else {
-		drawTriangle(tri);
+	startMeshJob(false, backgroundTessellation);
+	if (!backgroundTessellation) {
+		finishMeshJob();
 	}
-
-	delete midPoint1;
-	delete midPoint2;
-	delete midPoint3;
-
-	delete midPara1;
-	delete midPara2;
-	delete midPara3;
-
-	delete midReal1;
-	delete midReal2;
-	delete midReal3;
-
-	delete midNorm1;
-	delete midNorm2;
-	delete midNorm3;
-
-	delete t1;
-	delete t2;
-	delete t3;
-	delete t4;
 }
 
-void curveTraversal(BPatch patch){
-	Tuple t1, t2, t3, t4;
-
-	GLfloat old_u, new_u, old_v, new_v;
-	old_u = 0.0;
-	for (GLfloat u = 0.0; u < 1.0; u += stepSize) {
-		new_u = old_u + stepSize;
-		if (new_u > 1.0){
-			new_u = 1.0;
+// Uploads the vertices if they changed and the indices, which also change
+// on their own when the levels of detail do
+void uploadMesh(const Mesh& mesh) {
+#ifdef GL_VERSION_1_5
+	if (useBuffers) {
+		if (vertexBuffer == 0) {
+			glGenBuffers(1, &vertexBuffer);
+			glGenBuffers(1, &indexBuffer);
 		}
-		old_v = 0.0;
-		for (GLfloat v = 0.0; v < 1.0; v += stepSize) {
-			new_v = old_v + stepSize;
-			if (new_v > 1.0){
-				new_v = 1.0;
-			}
-			t1 = patchPoint(old_u, old_v, patch);
-			t2 = patchPoint(new_u, old_v, patch);
-			t3 = patchPoint(old_u, new_v, patch);
-			t4 = patchPoint(new_u, new_v, patch);
-
-			drawPolygon(t1, t2, t3, t4);
-			old_v = new_v;
+		if (!meshUploaded) {
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex),
+				mesh.vertices.empty() ? NULL : &mesh.vertices[0], GL_STATIC_DRAW);
 		}
-		old_u = new_u;
-	}	
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint),
+			mesh.indices.empty() ? NULL : &mesh.indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+#endif
+	meshUploaded = true;
+	indicesUploaded = true;
 }
 
-void adaptiveTraversal(BPatch patch) {
-	Triangle* t1 = new Triangle;
-	Triangle* t2 = new Triangle;
-
-	/* Triangle 1 real-world coordinates */
-	t1->p1 = patch.c1.p1;
-	t1->p2 = patch.c1.p4;
-	t1->p3 = patch.c4.p1;
-
-	/* Parametric Coordinates for triangle 1 (represented as point with z = 0.0) */
-	t1->pc1.x = 0.0;
-	t1->pc1.y = 0.0;
-	t1->pc1.z = 0.0;
-
-	t1->pc2.x = 1.0;
-	t1->pc2.y = 0.0;
-	t1->pc2.z = 0.0;
+void drawRange(const GLvoid* indices, size_t begin, size_t end) {
+	if (end > begin) {
+		countEvent(COUNTER_TRIANGLES_DRAWN, (end - begin) / 3);
+		glDrawElements(GL_TRIANGLES, end - begin, GL_UNSIGNED_INT, (const GLuint*) indices + begin);
+	}
+}
 
-	t1->pc3.x = 0.0;
-	t1->pc3.y = 1.0;
-	t1->pc3.z = 0.0;
+// Draws the patches visible this frame, one indexed call per run of
+// neighbouring visible patches, from buffer objects when available and from
+// the CPU-side arrays otherwise
+void drawMesh(const Mesh& mesh) {
+	ScopedTimer timer("submit");
+	if (mesh.indices.empty()) {
+		return;
+	}
+	if (!meshUploaded || !indicesUploaded) {
+		uploadMesh(mesh);
+	}
 
-	t1->n1 = patchPoint(t1->pc1.x, t1->pc1.y, patch).p2;
-	t1->n2 = patchPoint(t1->pc2.x, t1->pc2.y, patch).p2;
-	t1->n3 = patchPoint(t1->pc3.x, t1->pc3.y, patch).p2;
+	const GLvoid* base = &mesh.vertices[0];
+	const GLvoid* indices = &mesh.indices[0];
+#ifdef GL_VERSION_1_5
+	if (useBuffers) {
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		base = NULL;
+		indices = NULL;
+	}
+#endif
 
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (const char*) base + offsetof(Vertex, p));
+	glNormalPointer(GL_FLOAT, sizeof(Vertex), (const char*) base + offsetof(Vertex, n));
 
-	/* Triangle 2 real-world coordinates */
-	t2->p1 = patch.c4.p1;
-	t2->p2 = patch.c1.p4;
-	t2->p3 = patch.c4.p4;
+	size_t begin = 0, end = 0;
+	for (size_t i = 0; i < patchVisible.size(); i++) {
+		if (!patchVisible[i]) {
+			continue;
+		}
+		if (mesh.patchStarts[i] != end) {
+			drawRange(indices, begin, end);
+			begin = mesh.patchStarts[i];
+		}
+		end = mesh.patchStarts[i + 1];
+	}
+	drawRange(indices, begin, end);
+
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+#ifdef GL_VERSION_1_5
+	if (useBuffers) {
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+#endif
+}
 
-	/* Parametric Coordinates for triangle 2 (represented as point with z = 0.0) */
-	t2->pc1.x = 0.0;
-	t2->pc1.y = 1.0;
-	t2->pc1.z = 0.0;
+// Culls against the current GL matrices, reporting the counts when they
+// change
+void cullScene() {
+	GLfloat modelview[16], projection[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+
+	ViewVolume view;
+	view.set(modelview, projection);
+	CullStats stats = cullPatches(view, patchVisible);
+	if (stats.outside != cullStats.outside || stats.backFacing != cullStats.backFacing) {
+		std::cout << "Culled " << stats.outside + stats.backFacing << " of " << numPatches
+			<< " patches (" << stats.outside << " outside the view, " << stats.backFacing
+			<< " back-facing)" << std::endl;
+	}
+	cullStats = stats;
+}
 
-	t2->pc2.x = 1.0;
-	t2->pc2.y = 0.0;
-	t2->pc2.z = 0.0;
+// Prints the previous frame's profile over the top left of the window, one
+// line per timer and counter, with GLUT's bitmap font
+void drawStats() {
+	const FrameProfile& frame = lastProfileFrame();
+	std::vector<std::string> lines;
+	char line[128];
+	snprintf(line, sizeof(line), "frame %.2f ms", frame.duration * 1000.0);
+	lines.push_back(line);
+	for (size_t t = 0; t < frame.timers.size(); t++) {
+		snprintf(line, sizeof(line), "%s %.2f ms", frame.timers[t].first, frame.timers[t].second * 1000.0);
+		lines.push_back(line);
+	}
+	std::string depths = "depths";
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		if (c < COUNTER_DEPTH) {
+			snprintf(line, sizeof(line), "%s %llu", counterName(c), frame.counters[c]);
+			lines.push_back(line);
+		} else if (frame.counters[c] > 0) {
+			snprintf(line, sizeof(line), " %d:%llu", c - COUNTER_DEPTH, frame.counters[c]);
+			depths += line;
+		}
+	}
+	lines.push_back(depths);
 
-	t2->pc3.x = 1.0;
-	t2->pc3.y = 1.0;
-	t2->pc3.z = 0.0;
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glColor3f(1.0, 1.0, 0.0);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, viewport.w, 0, viewport.h, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
 
-	t2->n1 = patchPoint(t2->pc1.x, t2->pc1.y, patch).p2;
-	t2->n2 = patchPoint(t2->pc2.x, t2->pc2.y, patch).p2;
-	t2->n3 = patchPoint(t2->pc3.x, t2->pc3.y, patch).p2;
+	for (size_t i = 0; i < lines.size(); i++) {
+		glRasterPos2i(8, viewport.h - 16 - 15 * (int) i);
+		for (size_t c = 0; c < lines[i].size(); c++) {
+			glutBitmapCharacter(GLUT_BITMAP_8_BY_13, lines[i][c]);
+		}
+	}
 
-	subdivideTriangle(*t1, patch);
-	subdivideTriangle(*t2, patch);
-	delete t1, t2;
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
 }
 
-void uniformTesselation(){
-	for(unsigned int i = 0; i < bPatches.size(); i++){
-		curveTraversal(*(bPatches.at(i)));
+// The tolerance the keys and the frame budget adjust: the pixel error in
+// view-dependent adaptive mode and the step size or flatness otherwise.
+// Scales it by factor within its limits and returns whether it changed.
+bool scaleTolerance(GLfloat factor) {
+	GLfloat& tolerance = requestedAdaptive && requestedViewDependent
+		? requestedPixelError : requestedStepSize;
+	GLfloat finest = finestStep, coarsest = requestedAdaptive || requestedAnalytic ? sceneExtent : coarsestStep;
+	if (&tolerance == &requestedPixelError) {
+		finest = finestPixelError;
+		coarsest = coarsestPixelError;
 	}
+	GLfloat scaled = std::min(std::max(tolerance * factor, finest), coarsest);
+	bool changed = scaled != tolerance;
+	tolerance = scaled;
+	return changed;
 }
 
-void adaptiveTriangulation() {
-	for(unsigned int i = 0; i < bPatches.size(); i++){
-		adaptiveTraversal(*(bPatches.at(i)));
+void printStepSize() {
+	if (requestedAdaptive && requestedViewDependent) {
+		std::cout << "Adaptive, pixel error " << requestedPixelError << std::endl;
+	} else {
+		std::cout << (requestedAdaptive ? "Adaptive, tolerance "
+			: requestedAnalytic ? "Analytic, chord tolerance " : "Uniform, step ")
+			<< requestedStepSize << std::endl;
 	}
 }
 
-//****************************************************
-// File Parser
-//****************************************************
-void loadScene(std::string file) {
-	numPatches = 0;
-	int patchCount = 0;
-	int curveCount = 0;
-
-	GLfloat maxBoundaries = 0.0;
-
-	std::ifstream inpfile(file.c_str());
-	if(!inpfile.is_open()) {
-		std::cout << "Unable to open file" << std::endl;
-	} else {
-		std::string line;
-
-		while(inpfile.good()) {
-			std::vector<std::string> splitline;
-			std::string buf;
-
-			std::getline(inpfile,line);
-			std::stringstream ss(line);
-
-			while (ss >> buf) {
-				splitline.push_back(buf);
-			}
-
-			//Ignore blank lines
-			if(splitline.size() == 0) {
-				continue;
-			}
-
-			if(splitline.size() == 1) {
-				numPatches = atoi(splitline[0].c_str());
-				for (int i = 0; i < numPatches; i++) {
-					BPatch* newPatch = new BPatch;
-					bPatches.push_back(newPatch);
-				}
-			} else {
-				if (patchCount < numPatches) {
-
-					for (int i = 0; i < 12; i++) {
-						if (maxBoundaries < atof(splitline[i].c_str())) {
-							maxBoundaries = atof(splitline[i].c_str());
-						}
-					}
-
-					if (curveCount == 3) {
-
-						Point* tempP1 = new Point;
-						Point* tempP2 = new Point;
-						Point* tempP3 = new Point;
-						Point* tempP4 = new Point;
-
-						tempP1->x = atof(splitline[0].c_str());
-						tempP1->y = atof(splitline[1].c_str());
-						tempP1->z = atof(splitline[2].c_str());
-
-						tempP2->x = atof(splitline[3].c_str());
-						tempP2->y = atof(splitline[4].c_str());
-						tempP2->z = atof(splitline[5].c_str());
-
-						tempP3->x = atof(splitline[6].c_str());
-						tempP3->y = atof(splitline[7].c_str());
-						tempP3->z = atof(splitline[8].c_str());
-
-						tempP4->x = atof(splitline[9].c_str());
-						tempP4->y = atof(splitline[10].c_str());
-						tempP4->z = atof(splitline[11].c_str());
-
-						BCurve* tempC = new BCurve;
-						tempC->p1 = *tempP1;
-						tempC->p2 = *tempP2;
-						tempC->p3 = *tempP3;
-						tempC->p4 = *tempP4;
-
-						bPatches.at(patchCount)->c4 = *tempC;
-
-						patchCount++;
-						curveCount = 0;
-
-					} else {
-
-						Point* tempP1 = new Point;
-						Point* tempP2 = new Point;
-						Point* tempP3 = new Point;
-						Point* tempP4 = new Point;
-
-						tempP1->x = atof(splitline[0].c_str());
-						tempP1->y = atof(splitline[1].c_str());
-						tempP1->z = atof(splitline[2].c_str());
-
-						tempP2->x = atof(splitline[3].c_str());
-						tempP2->y = atof(splitline[4].c_str());
-						tempP2->z = atof(splitline[5].c_str());
-
-						tempP3->x = atof(splitline[6].c_str());
-						tempP3->y = atof(splitline[7].c_str());
-						tempP3->z = atof(splitline[8].c_str());
-
-						tempP4->x = atof(splitline[9].c_str());
-						tempP4->y = atof(splitline[10].c_str());
-						tempP4->z = atof(splitline[11].c_str());
-
-						BCurve* tempC = new BCurve;
-						tempC->p1 = *tempP1;
-						tempC->p2 = *tempP2;
-						tempC->p3 = *tempP3;
-						tempC->p4 = *tempP4;
-
-						if (curveCount == 0) {
-							bPatches.at(patchCount)->c1 = *tempC;
-						} else if (curveCount == 1) {
-							bPatches.at(patchCount)->c2 = *tempC;
-						} else {
-							bPatches.at(patchCount)->c3 = *tempC;
-						}
-
-						curveCount++;
-					}
-				}
-			}
-		}
-		inpfile.close();
+// Feeds a frame drawn with a finished mesh to the frame budget, and applies
+// the tolerance it asks for. In the window, tessellation runs in the
+// background, so the frames measure culling and drawing. Meshes rebuilt
+// for a new view keep their tolerance and go on being measured.
+void budgetFrame(const FrameTimes& times) {
+	if (targetFrameSeconds <= 0.0 || meshThread.joinable() || meshProgressive) {
+		return;
+	}
+	GLfloat tolerance = meshAdaptive && viewDependent ? tessellationView.pixelError : meshStepSize;
+	if (tolerance != budgetTolerance || meshAdaptive != budgetAdaptive
+		|| meshAnalytic != budgetAnalytic) {
+		budgetTolerance = tolerance;
+		budgetAdaptive = meshAdaptive;
+		budgetAnalytic = meshAnalytic;
+		frameBudget.reset();
+	}
+	float factor = frameBudget.update(times.total, requestedAdaptive || requestedAnalytic ? 1.0 : 2.0);
+	if (factor != 1.0 && scaleTolerance(factor)) {
+		std::cout << "Frame budget: " << frameBudget.average() * 1000.0 << " ms for "
+			<< targetFrameSeconds * 1000.0 << ", ";
+		printStepSize();
 	}
-	maxX = maxY = maxBoundaries;
 }
 
-
 //****************************************************
 // function that does the actual drawing of stuff
 //***************************************************
-void myDisplay() {
+void renderScene(FrameTimes* times) {
+	beginProfileFrame();
+	double start = currentTime();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// clear the color buffer
 
 	glMatrixMode(GL_MODELVIEW);
@@ -900,20 +619,137 @@ void myDisplay() {
 	glRotatef(xRot, 1.0, 0.0, 0.0);
 	glRotatef(yRot, 0.0, 1.0, 0.0);
 
-	if (adaptive) {
-		adaptiveTriangulation();
+	cullScene();
+	double tessellateStart = currentTime();
+	updateMesh();
+	double submitStart = currentTime();
+	drawMesh(mesh);
+	if (showStats) {
+		drawStats();
+	}
+
+	if (times) {
+		times->tessellate = submitStart - tessellateStart;
+		times->submit = currentTime() - submitStart;
+		glFinish();
+		times->total = currentTime() - start;
+	}
+	endProfileFrame();
+}
+
+void nextFrame(int value) {
+	frameTimerArmed = false;
+	if (animating) {
+		double now = currentTime();
+		yRot += animationSpeed * (now - animationTime);
+		animationTime = now;
+		glutPostRedisplay();
+	}
+}
+
+void myDisplay() {
+	double start = currentTime();
+	if (targetFrameSeconds > 0.0) {
+		FrameTimes times;
+		renderScene(&times);
+		budgetFrame(times);
 	} else {
-		uniformTesselation();
+		renderScene(NULL);
 	}
 
 	glFlush();
 	glutSwapBuffers();					// swap buffers (we earlier set double buffer)
+
+	// A static scene draws no frames by itself, so keep drawing until the
+	// budget has judged the mesh
+	if (targetFrameSeconds > 0.0 && frameBudget.measuring()) {
+		glutPostRedisplay();
+	}
+	if (animating && !frameTimerArmed) {
+		int elapsed = (int) ((currentTime() - start) * 1000.0);
+		glutTimerFunc(std::max(frameInterval - elapsed, 0), nextFrame, 0);
+		frameTimerArmed = true;
+	}
+}
+
+//****************************************************
+// Rendering without a display
+//****************************************************
+
+// Renders cmd.offscreenFrames frames of the scene into an offscreen
+// framebuffer, turning it once about y over the run so view-dependent
+// modes do their per-frame work, and prints each frame's timings and a
+// summary. The first frame also pays for the initial tessellation.
+int runOffscreen(const CommandLine& cmd) {
+	initTessellator();
+	if (!loadScene(cmd.input)) {
+		return 1;
+	}
+	computePatchBounds();
+
+	OffscreenContext context;
+	if (!context.create(cmd.width, cmd.height)) {
+		return 1;
+	}
+	viewport.w = cmd.width;
+	viewport.h = cmd.height;
+	initScene();
+	maxX = maxY = sceneExtent;
+	myReshape(viewport.w, viewport.h);
+
+	std::cout << "renderer: " << context.renderer() << "\n"
+		<< "frame  tessellate_ms  submit_ms  frame_ms" << std::endl;
+	std::vector<double> frameTimes;
+	double tessellateSum = 0.0, submitSum = 0.0;
+	float startRot = yRot;
+	for (int frame = 0; frame < cmd.offscreenFrames; frame++) {
+		yRot = startRot + 360.0f * frame / cmd.offscreenFrames;
+
+		FrameTimes times;
+		renderScene(&times);
+		budgetFrame(times);
+		printf("%5d  %13.3f  %9.3f  %8.3f\n", frame, times.tessellate * 1000.0,
+			times.submit * 1000.0, times.total * 1000.0);
+		frameTimes.push_back(times.total);
+		tessellateSum += times.tessellate;
+		submitSum += times.submit;
+	}
+	fflush(stdout);
+
+	if (!cmd.ppm.empty() && !writeFramebufferPpm(cmd.ppm, cmd.width, cmd.height)) {
+		return 1;
+	}
+	if (!cmd.profile.empty() && !writeProfile(cmd.profile)) {
+		return 1;
+	}
+
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	double frameSum = 0.0;
+	for (size_t i = 0; i < frameTimes.size(); i++) {
+		frameSum += frameTimes[i];
+	}
+	size_t frames = frameTimes.size();
+	std::cout << "frames:     " << frames << "\n"
+		<< "tessellate: " << tessellateSum / frames * 1000.0 << " ms mean\n"
+		<< "submit:     " << submitSum / frames * 1000.0 << " ms mean\n"
+		<< "frame:      " << frameSum / frames * 1000.0 << " ms mean, "
+		<< sorted[frames / 2] * 1000.0 << " median, " << sorted[frames - 1] * 1000.0 << " max\n"
+		<< "fps:        " << frames / frameSum << std::endl;
+	return 0;
 }
 
 
+// Where to write the window's profile on exit, empty for nowhere
+std::string profileFile;
+
+
 void keyboard(unsigned char key, int x, int y) {
 	switch (key)  {
 	case 32: // Space key
+		if (!profileFile.empty()) {
+			writeProfile(profileFile);
+		}
 		exit (0);
 		break;
 	case 61: //+ key
@@ -922,6 +758,36 @@ void keyboard(unsigned char key, int x, int y) {
 	case 45: // - key
 		scaleValue -= 0.1;
 		break;
+	case 118: //v key
+		requestedViewDependent = !requestedViewDependent;
+		break;
+	case 97: //a key
+		requestedAdaptive = !requestedAdaptive;
+		printStepSize();
+		break;
+	case 100: //d key
+		requestedAnalytic = !requestedAnalytic;
+		printStepSize();
+		break;
+	case 91: //[ key
+		scaleTolerance(stepFactor);
+		printStepSize();
+		break;
+	case 93: //] key
+		scaleTolerance(1.0 / stepFactor);
+		printStepSize();
+		break;
+	case 98: //b key
+		cullBackFaces = !cullBackFaces;
+		break;
+	case 105: //i key
+		showStats = !showStats;
+		profiling = showStats || !profileFile.empty();
+		break;
+	case 114: //r key
+		animating = !animating;
+		animationTime = currentTime();
+		break;
 	case 115: //s key
 		if (smooth){
 			glShadeModel(GL_FLAT);
@@ -940,7 +806,10 @@ void keyboard(unsigned char key, int x, int y) {
 			wired = false;
 		}
 		break;
+	default:
+		return;
 	}
+	glutPostRedisplay();
 }
 
 void SpecialKeys(int key, int x, int y)
@@ -975,29 +844,40 @@ void SpecialKeys(int key, int x, int y)
 			yTran -= 0.5;
 		}
 		break;
+	default:
+		return;
 	}
-}
-
-void myFrameMove() {
-	//nothing here for now
-#ifdef _WIN32
-	Sleep(10);                                   //give ~10ms back to OS (so as not to waste the CPU)
-#endif
-	glutPostRedisplay(); // forces glut to call the display function (myDisplay())
+	glutPostRedisplay();
 }
 
 //****************************************************
 // the usual stuff, nothing exciting here
 //****************************************************
 int main(int argc, char *argv[]) {
-
-	if (argc > 3) {
-		adaptive = true;
+	CommandLine cmd;
+	if (!parseCommandLine(argc, argv, cmd)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (cmd.headless) {
+		return runBatch(cmd);
+	}
+	requestedStepSize = stepSize;
+	requestedAdaptive = adaptive;
+	requestedAnalytic = analyticDensity;
+	requestedViewDependent = viewDependent;
+	requestedPixelError = tessellationView.pixelError;
+	if (cmd.offscreenFrames > 0) {
+		return runOffscreen(cmd);
 	}
 
-	std::string filename = argv[1];
-	stepSize = atof(argv[2]);
-	loadScene(filename);
+	// Parse the scene while GLUT brings up the window
+	profileFile = cmd.profile;
+	backgroundTessellation = true;
+	progressiveRefinement = true;
+	atexit(waitForMeshJob);
+	initTessellator();
+	startSceneLoad(cmd.input);
 
 	//This initializes glut
 	glutInit(&argc, argv);
@@ -1006,8 +886,8 @@ int main(int argc, char *argv[]) {
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
 	// Initalize theviewport size
-	viewport.w = 1000;
-	viewport.h = 1000;
+	viewport.w = cmd.width;
+	viewport.h = cmd.height;
 
 	//The size and position of the window
 	glutInitWindowSize(viewport.w, viewport.h);
@@ -1016,9 +896,15 @@ int main(int argc, char *argv[]) {
 
 	initScene();							// quick function to set up scene
 
+	if (!finishSceneLoad()) {
+		return 1;
+	}
+	computePatchBounds();
+	maxX = maxY = sceneExtent;
+	myReshape(viewport.w, viewport.h);
+
 	glutDisplayFunc(myDisplay);				// function to run when its time to draw something
 	glutReshapeFunc(myReshape);				// function to run when the window gets resized
-	glutIdleFunc(myFrameMove);	
 	glutKeyboardFunc(keyboard);
 	glutSpecialFunc(SpecialKeys);
 
@@ -1027,4 +913,3 @@ int main(int argc, char *argv[]) {
 
 	return 0;
 }
-
@@ -0,0 +1,121 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : bytes(NULL), length(0), fileHandle(NULL), mappingHandle(NULL) {}
+
+bool MappedFile::open(const std::string& file) {
+	close();
+	HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	fileHandle = handle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize)) {
+		close();
+		return false;
+	}
+	if (fileSize.QuadPart == 0) {
+		return true;
+	}
+
+	mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) {
+		close();
+		return false;
+	}
+	bytes = (const char*) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (bytes == NULL) {
+		close();
+		return false;
+	}
+	length = (size_t) fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (bytes) {
+		UnmapViewOfFile(bytes);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle) {
+		CloseHandle(fileHandle);
+	}
+	bytes = NULL;
+	length = 0;
+	fileHandle = NULL;
+	mappingHandle = NULL;
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(NULL), length(0) {}
+
+bool MappedFile::open(const std::string& file) {
+	close();
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+	if (info.st_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	void* address = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	// The file is read front to back (or in large chunks per thread)
+	madvise(address, info.st_size, MADV_SEQUENTIAL);
+
+	bytes = (const char*) address;
+	length = info.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (bytes) {
+		munmap((void*) bytes, length);
+	}
+	bytes = NULL;
+	length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+void MappedFile::swap(MappedFile& other) {
+	std::swap(bytes, other.bytes);
+	std::swap(length, other.length);
+#ifdef _WIN32
+	std::swap(fileHandle, other.fileHandle);
+	std::swap(mappingHandle, other.mappingHandle);
+#endif
+}
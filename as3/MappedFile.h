@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+//****************************************************
+// Read-only memory mapping of a whole file
+//****************************************************
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Maps file, replacing any previous mapping; false if it can't be opened
+	// or mapped. An empty file maps to size() == 0 and data() == NULL.
+	bool open(const std::string& file);
+	void close();
+
+	// Exchanges mappings, e.g. to keep one alive past the function that opened it
+	void swap(MappedFile& other);
+
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* bytes;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
+
+#endif
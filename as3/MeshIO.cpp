@@ -0,0 +1,238 @@
+#include "MeshIO.h"
+
+#include <iostream>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+bool littleEndian() {
+	unsigned int one = 1;
+	return *(unsigned char*) &one == 1;
+}
+
+bool hasExtension(const std::string& file, const char* ext) {
+	size_t n = strlen(ext);
+	if (file.size() < n) {
+		return false;
+	}
+	for (size_t i = 0; i < n; i++) {
+		char c = file[file.size() - n + i];
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		if (c != ext[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Counts are printed with a fixed width when they will be patched later
+void writePlyHeader(FILE* out, size_t vertices, size_t faces, int width,
+	long* vertexCountAt, long* faceCountAt) {
+	fprintf(out, "ply\n");
+	fprintf(out, "format %s 1.0\n", littleEndian() ? "binary_little_endian" : "binary_big_endian");
+	fprintf(out, "element vertex ");
+	if (vertexCountAt) {
+		*vertexCountAt = ftell(out);
+	}
+	fprintf(out, "%0*lu\n", width, (unsigned long) vertices);
+	fprintf(out, "property float x\nproperty float y\nproperty float z\n");
+	fprintf(out, "property float nx\nproperty float ny\nproperty float nz\n");
+	fprintf(out, "element face ");
+	if (faceCountAt) {
+		*faceCountAt = ftell(out);
+	}
+	fprintf(out, "%0*lu\n", width, (unsigned long) faces);
+	fprintf(out, "property list uchar uint vertex_indices\n");
+	fprintf(out, "end_header\n");
+}
+
+void writePlyVertices(FILE* out, const Mesh& mesh) {
+	// Vertex is six packed floats, exactly the PLY vertex record
+	if (!mesh.vertices.empty()) {
+		fwrite(&mesh.vertices[0], sizeof(Vertex), mesh.vertices.size(), out);
+	}
+}
+
+// Writes the triangles with offset added to every index
+void writePlyFaces(FILE* out, const Mesh& mesh, unsigned int offset) {
+	// Faces are 13-byte records, so pack them through a buffer
+	const size_t faceSize = 1 + 3 * sizeof(unsigned int);
+	const size_t chunk = 4096;
+	unsigned char buffer[chunk * faceSize];
+	size_t faces = mesh.indices.size() / 3;
+	for (size_t f = 0; f < faces; f += chunk) {
+		size_t count = faces - f < chunk ? faces - f : chunk;
+		unsigned char* p = buffer;
+		for (size_t i = 0; i < count; i++) {
+			unsigned int face[3];
+			for (int k = 0; k < 3; k++) {
+				face[k] = mesh.indices[(f + i) * 3 + k] + offset;
+			}
+			*p++ = 3;
+			memcpy(p, face, sizeof(face));
+			p += sizeof(face);
+		}
+		fwrite(buffer, faceSize, count, out);
+	}
+}
+
+// OBJ indices are global and 1-based; offset is the number of vertices
+// already in the file
+void writeObjVertices(FILE* out, const Mesh& mesh) {
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		const Point& p = mesh.vertices[i].p;
+		fprintf(out, "v %g %g %g\n", p.x, p.y, p.z);
+	}
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		const Point& n = mesh.vertices[i].n;
+		fprintf(out, "vn %g %g %g\n", n.x, n.y, n.z);
+	}
+}
+
+void writeObjFaces(FILE* out, const Mesh& mesh, unsigned long long offset) {
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		unsigned long long a = mesh.indices[i] + offset + 1;
+		unsigned long long b = mesh.indices[i + 1] + offset + 1;
+		unsigned long long c = mesh.indices[i + 2] + offset + 1;
+		fprintf(out, "f %llu//%llu %llu//%llu %llu//%llu\n", a, a, b, b, c, c);
+	}
+}
+
+bool finishFile(FILE* out, const std::string& file) {
+	bool ok = !ferror(out);
+	if (fclose(out) != 0 || !ok) {
+		std::cerr << "Error writing " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+}
+
+bool writePly(const Mesh& mesh, const std::string& file) {
+	FILE* out = fopen(file.c_str(), "wb");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	writePlyHeader(out, mesh.vertices.size(), mesh.indices.size() / 3, 0, NULL, NULL);
+	writePlyVertices(out, mesh);
+	writePlyFaces(out, mesh, 0);
+	return finishFile(out, file);
+}
+
+bool writeObj(const Mesh& mesh, const std::string& file) {
+	FILE* out = fopen(file.c_str(), "w");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	writeObjVertices(out, mesh);
+	writeObjFaces(out, mesh, 0);
+	return finishFile(out, file);
+}
+
+bool writeMesh(const Mesh& mesh, const std::string& file) {
+	if (hasExtension(file, ".obj")) {
+		return writeObj(mesh, file);
+	}
+	if (hasExtension(file, ".ply")) {
+		return writePly(mesh, file);
+	}
+	std::cerr << "Unknown mesh format for " << file << " (use .ply or .obj)" << std::endl;
+	return false;
+}
+
+//****************************************************
+// Streaming output
+//****************************************************
+
+// Wide enough for any count that fits the 32-bit indices, which append()
+// checks
+static const int plyCountWidth = 10;
+
+MeshWriter::MeshWriter() : out(NULL), faces(NULL), ply(false),
+	vertexCountAt(0), faceCountAt(0), vertices(0), triangles(0) {}
+
+MeshWriter::~MeshWriter() {
+	if (out) {
+		fclose(out);
+	}
+	if (faces) {
+		fclose(faces);
+	}
+}
+
+bool MeshWriter::open(const std::string& name) {
+	file = name;
+	ply = hasExtension(file, ".ply");
+	if (!ply && !hasExtension(file, ".obj")) {
+		std::cerr << "Unknown mesh format for " << file << " (use .ply or .obj)" << std::endl;
+		return false;
+	}
+
+	out = fopen(file.c_str(), ply ? "wb" : "w");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	if (ply) {
+		// Faces come after every vertex in a PLY file, so they wait in a
+		// temporary file until close()
+		faces = tmpfile();
+		if (!faces) {
+			std::cerr << "Unable to create a temporary file for " << file << std::endl;
+			return false;
+		}
+		writePlyHeader(out, 0, 0, plyCountWidth, &vertexCountAt, &faceCountAt);
+	}
+	return true;
+}
+
+// PLY indices are 32 bits, so a PLY file holds at most 2^32 vertices; OBJ
+// indices are text and go past that
+bool MeshWriter::append(const Mesh& mesh) {
+	if (ply) {
+		if (vertices + mesh.vertices.size() > (unsigned long long) UINT_MAX + 1) {
+			std::cerr << file << ": more than 2^32 vertices, past what PLY's 32-bit indices reach"
+				<< " (write .obj instead)" << std::endl;
+			return false;
+		}
+		writePlyVertices(out, mesh);
+		writePlyFaces(faces, mesh, (unsigned int) vertices);
+	} else {
+		writeObjVertices(out, mesh);
+		writeObjFaces(out, mesh, vertices);
+	}
+	vertices += mesh.vertices.size();
+	triangles += mesh.indices.size() / 3;
+	return !ferror(out) && !(faces && ferror(faces));
+}
+
+bool MeshWriter::close() {
+	bool ok = true;
+	if (ply) {
+		std::vector<char> buffer(1 << 20);
+		rewind(faces);
+		size_t read;
+		while ((read = fread(&buffer[0], 1, buffer.size(), faces)) > 0) {
+			fwrite(&buffer[0], 1, read, out);
+		}
+		ok = !ferror(faces);
+		fclose(faces);
+		faces = NULL;
+
+		fseek(out, vertexCountAt, SEEK_SET);
+		fprintf(out, "%0*lu", plyCountWidth, (unsigned long) vertices);
+		fseek(out, faceCountAt, SEEK_SET);
+		fprintf(out, "%0*lu", plyCountWidth, (unsigned long) triangles);
+	}
+	ok = finishFile(out, file) && ok;
+	out = NULL;
+	return ok;
+}
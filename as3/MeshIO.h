@@ -0,0 +1,51 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include <string>
+#include <stdio.h>
+
+#include "Bezier.h"
+
+//****************************************************
+// Mesh output
+//****************************************************
+
+// Binary PLY with per-vertex position and normal and triangle faces
+bool writePly(const Mesh& mesh, const std::string& file);
+
+// Wavefront OBJ with v/vn records and f a//a b//b c//c faces
+bool writeObj(const Mesh& mesh, const std::string& file);
+
+// Picks the format from the extension (.ply or .obj)
+bool writeMesh(const Mesh& mesh, const std::string& file);
+
+// Writes a mesh that arrives in pieces, each indexed from 0, without ever
+// holding all of it. PLY faces are spooled to a temporary file and the
+// header counts (zero-padded) are filled in by close(). PLY's 32-bit indices
+// reach 2^32 vertices, past which append() fails; OBJ has no such limit.
+class MeshWriter {
+public:
+	MeshWriter();
+	~MeshWriter();
+
+	// Picks the format from the extension (.ply or .obj)
+	bool open(const std::string& file);
+	bool append(const Mesh& mesh);
+	bool close();
+
+	size_t vertexCount() const { return vertices; }
+	size_t triangleCount() const { return triangles; }
+
+private:
+	MeshWriter(const MeshWriter&);
+	MeshWriter& operator=(const MeshWriter&);
+
+	std::string file;
+	FILE* out;
+	FILE* faces;
+	bool ply;
+	long vertexCountAt, faceCountAt;
+	size_t vertices, triangles;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "Offscreen.h"
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+OffscreenContext::OffscreenContext() : display(NULL), context(NULL), framebuffer(0) {
+	renderbuffers[0] = renderbuffers[1] = 0;
+}
+
+OffscreenContext::~OffscreenContext() {
+	destroy();
+}
+
+#ifdef HAVE_EGL
+
+bool OffscreenContext::create(int width, int height) {
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		std::cerr << "Unable to initialize EGL" << std::endl;
+		return false;
+	}
+	display = eglDisplay;
+
+	const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+		std::cerr << "EGL has no surfaceless contexts" << std::endl;
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cerr << "EGL has no desktop OpenGL" << std::endl;
+		return false;
+	}
+
+	const EGLint attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	eglChooseConfig(eglDisplay, attributes, &config, 1, &configs);
+	context = eglCreateContext(eglDisplay, configs > 0 ? config : (EGLConfig) 0, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT
+		|| !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext) context)) {
+		std::cerr << "Unable to create an offscreen GL context" << std::endl;
+		context = NULL;
+		return false;
+	}
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void OffscreenContext::destroy() {
+	if (context) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(2, renderbuffers);
+		glDeleteFramebuffers(1, &framebuffer);
+		eglMakeCurrent((EGLDisplay) display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay) display, (EGLContext) context);
+		context = NULL;
+	}
+	if (display) {
+		eglTerminate((EGLDisplay) display);
+		display = NULL;
+	}
+}
+
+std::string OffscreenContext::renderer() const {
+	const char* name = context ? (const char*) glGetString(GL_RENDERER) : NULL;
+	return name ? name : "";
+}
+
+bool writeFramebufferPpm(const std::string& file, int width, int height) {
+	std::vector<unsigned char> pixels((size_t) width * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE* out = fopen(file.c_str(), "wb");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	fprintf(out, "P6\n%d %d\n255\n", width, height);
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--) {
+		ok = fwrite(&pixels[(size_t) y * width * 3], 3, width, out) == (size_t) width;
+	}
+	if (fclose(out) != 0 || !ok) {
+		std::cerr << "Error writing " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#else
+
+bool OffscreenContext::create(int width, int height) {
+	std::cerr << "Offscreen rendering needs EGL, which this build doesn't have" << std::endl;
+	return false;
+}
+
+void OffscreenContext::destroy() {
+}
+
+std::string OffscreenContext::renderer() const {
+	return "";
+}
+
+bool writeFramebufferPpm(const std::string& file, int width, int height) {
+	std::cerr << "Offscreen rendering needs EGL, which this build doesn't have" << std::endl;
+	return false;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <string>
+
+//****************************************************
+// Offscreen rendering
+//
+// A desktop GL context with no window, for rendering on machines without a
+// display: EGL on Mesa's surfaceless platform (llvmpipe when there's no
+// GPU), drawing into a framebuffer object. Only built where EGL is
+// available (HAVE_EGL); elsewhere create() reports that and fails.
+//****************************************************
+
+class OffscreenContext {
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	// Creates the context and makes a width x height color and depth
+	// framebuffer current. Returns false (after printing why) on failure.
+	bool create(int width, int height);
+	void destroy();
+
+	// GL_RENDERER of the context, for reports
+	std::string renderer() const;
+
+private:
+	OffscreenContext(const OffscreenContext&);
+	OffscreenContext& operator=(const OffscreenContext&);
+
+	void* display;
+	void* context;
+	unsigned int framebuffer;
+	unsigned int renderbuffers[2];
+};
+
+// Reads back the current framebuffer's width x height pixels and writes
+// them to file as a binary PPM, top row first
+bool writeFramebufferPpm(const std::string& file, int width, int height);
+
+#endif
@@ -0,0 +1,122 @@
+#include "PatchSimdKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PATCH_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+#if defined(PATCH_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+class Float1 {
+public:
+	static const int width = 1;
+	float v;
+
+	Float1() {}
+	Float1(float value) : v(value) {}
+
+	static Float1 set(float f) { return f; }
+	static Float1 load(const float* p) { return *p; }
+	static Float1 madd(Float1 a, Float1 b, Float1 c) { return a.v * b.v + c.v; }
+	void store(float* p) const { *p = v; }
+
+	Float1 operator+(Float1 o) const { return v + o.v; }
+	Float1 operator-(Float1 o) const { return v - o.v; }
+	Float1 operator*(Float1 o) const { return v * o.v; }
+};
+
+#ifdef PATCH_SIMD_X86
+class Float4 {
+public:
+	static const int width = 4;
+	__m128 v;
+
+	Float4() {}
+	Float4(__m128 value) : v(value) {}
+
+	static Float4 set(float f) { return _mm_set1_ps(f); }
+	static Float4 load(const float* p) { return _mm_loadu_ps(p); }
+	static Float4 madd(Float4 a, Float4 b, Float4 c) { return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+
+	Float4 operator+(Float4 o) const { return _mm_add_ps(v, o.v); }
+	Float4 operator-(Float4 o) const { return _mm_sub_ps(v, o.v); }
+	Float4 operator*(Float4 o) const { return _mm_mul_ps(v, o.v); }
+};
+#endif
+
+bool cpuHasAvx2() {
+#if defined(PATCH_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(PATCH_SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+PatchEvaluator evaluator = detectPatchEvaluator();
+
+}
+
+PatchEvaluator detectPatchEvaluator() {
+#ifdef PATCH_SIMD_X86
+	return cpuHasAvx2() ? EVALUATOR_AVX2 : EVALUATOR_SSE2;
+#else
+	return EVALUATOR_SCALAR;
+#endif
+}
+
+bool setPatchEvaluator(PatchEvaluator requested) {
+	if (requested > detectPatchEvaluator()) {
+		return false;
+	}
+	evaluator = requested;
+	return true;
+}
+
+PatchEvaluator currentPatchEvaluator() {
+	return evaluator;
+}
+
+const char* patchEvaluatorName(PatchEvaluator which) {
+	switch (which) {
+	case EVALUATOR_AVX2:
+		return "avx2";
+	case EVALUATOR_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
+
+void evaluatePatchBatch(const PatchSoA& patch, const float* u, const float* v,
+	int count, const PatchBatch& out) {
+	int i = 0;
+	if (evaluator == EVALUATOR_AVX2) {
+		i = evaluatePatchRangeAvx2(patch, u, v, out, i, count);
+	}
+#ifdef PATCH_SIMD_X86
+	if (evaluator >= EVALUATOR_SSE2) {
+		i = evaluateRange<Float4>(patch, u, v, out, i, count);
+	}
+#endif
+	evaluateRange<Float1>(patch, u, v, out, i, count);
+}
@@ -0,0 +1,46 @@
+#ifndef PATCH_SIMD_H
+#define PATCH_SIMD_H
+
+//****************************************************
+// Batched Bezier patch evaluation
+//
+// Evaluates a bicubic patch at many (u,v) parameters per call, 4 (SSE2) or
+// 8 (AVX2) at a time, picking the widest instruction set the CPU supports
+// at runtime and falling back to scalar code elsewhere.
+//****************************************************
+
+// Structure-of-arrays copy of a 4x4 control net, indexed [curve * 4 + point]
+// like controlNet() in Bezier.cpp: points run along u, curves along v
+class PatchSoA {
+public:
+	float x[16], y[16], z[16];
+};
+
+// Planar output arrays, each holding one value per evaluated sample
+class PatchBatch {
+public:
+	float *px, *py, *pz;		// position
+	float *dux, *duy, *duz;		// dP/du
+	float *dvx, *dvy, *dvz;		// dP/dv
+};
+
+enum PatchEvaluator {
+	EVALUATOR_SCALAR,
+	EVALUATOR_SSE2,
+	EVALUATOR_AVX2
+};
+
+// Evaluates samples [0, count) at (u[i], v[i]) into out
+void evaluatePatchBatch(const PatchSoA& patch, const float* u, const float* v,
+	int count, const PatchBatch& out);
+
+// Best evaluator supported by this CPU (and build)
+PatchEvaluator detectPatchEvaluator();
+
+// Forces an evaluator; returns false if it is not available here
+bool setPatchEvaluator(PatchEvaluator evaluator);
+
+PatchEvaluator currentPatchEvaluator();
+const char* patchEvaluatorName(PatchEvaluator evaluator);
+
+#endif
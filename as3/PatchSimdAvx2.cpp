@@ -0,0 +1,43 @@
+#include "PatchSimdKernel.h"
+
+// Built with -mavx2 -mfma (see the Makefile) and only called after
+// detectPatchEvaluator() has confirmed CPU support.
+
+#if (defined(__AVX2__) && defined(__FMA__)) || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+#include <immintrin.h>
+
+namespace {
+
+class Float8 {
+public:
+	static const int width = 8;
+	__m256 v;
+
+	Float8() {}
+	Float8(__m256 value) : v(value) {}
+
+	static Float8 set(float f) { return _mm256_set1_ps(f); }
+	static Float8 load(const float* p) { return _mm256_loadu_ps(p); }
+	static Float8 madd(Float8 a, Float8 b, Float8 c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	Float8 operator+(Float8 o) const { return _mm256_add_ps(v, o.v); }
+	Float8 operator-(Float8 o) const { return _mm256_sub_ps(v, o.v); }
+	Float8 operator*(Float8 o) const { return _mm256_mul_ps(v, o.v); }
+};
+
+}
+
+int evaluatePatchRangeAvx2(const PatchSoA& patch, const float* u, const float* v,
+	const PatchBatch& out, int begin, int end) {
+	return evaluateRange<Float8>(patch, u, v, out, begin, end);
+}
+
+#else
+
+int evaluatePatchRangeAvx2(const PatchSoA& patch, const float* u, const float* v,
+	const PatchBatch& out, int begin, int end) {
+	return begin;
+}
+
+#endif
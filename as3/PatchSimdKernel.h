@@ -0,0 +1,106 @@
+#ifndef PATCH_SIMD_KERNEL_H
+#define PATCH_SIMD_KERNEL_H
+
+#include "PatchSimd.h"
+
+//****************************************************
+// Evaluation kernel shared by the scalar, SSE2 and AVX2 builds. Each
+// translation unit instantiates it with its own lane type; everything lives
+// in an anonymous namespace so code compiled with -mavx2 can never be
+// merged into the baseline build by the linker.
+//****************************************************
+
+namespace {
+
+// Writes the cubic Bernstein weights and their derivatives at t (s = 1 - t)
+template <class V>
+inline void bernsteinWeights(V t, V s, V* b, V* db) {
+	V three = V::set(3.0f);
+	V six = V::set(6.0f);
+	V ss = s * s;
+	V tt = t * t;
+	V ts = t * s;
+
+	b[0] = ss * s;
+	b[1] = three * t * ss;
+	b[2] = three * tt * s;
+	b[3] = tt * t;
+
+	db[0] = V::set(0.0f) - three * ss;
+	db[1] = three * ss - six * ts;
+	db[2] = six * ts - three * tt;
+	db[3] = three * tt;
+}
+
+// sum w[l] * c[base + l] for l in 0..3
+template <class V>
+inline V contractNet(const V* w, const float* c, int base) {
+	V r = w[0] * V::set(c[base]);
+	r = V::madd(w[1], V::set(c[base + 1]), r);
+	r = V::madd(w[2], V::set(c[base + 2]), r);
+	r = V::madd(w[3], V::set(c[base + 3]), r);
+	return r;
+}
+
+template <class V>
+inline V contract(const V* w, const V* c) {
+	V r = w[0] * c[0];
+	r = V::madd(w[1], c[1], r);
+	r = V::madd(w[2], c[2], r);
+	r = V::madd(w[3], c[3], r);
+	return r;
+}
+
+// Evaluates V::width samples starting at index i
+template <class V>
+inline void evaluateLanes(const PatchSoA& p, const float* u, const float* v,
+	const PatchBatch& out, int i) {
+	V one = V::set(1.0f);
+	V uu = V::load(u + i);
+	V vv = V::load(v + i);
+
+	V bu[4], dbu[4], bv[4], dbv[4];
+	bernsteinWeights(uu, one - uu, bu, dbu);
+	bernsteinWeights(vv, one - vv, bv, dbv);
+
+	// Reduce each curve at u to get the v-curve and its u-derivative
+	V cx[4], cy[4], cz[4], dx[4], dy[4], dz[4];
+	for (int k = 0; k < 4; k++) {
+		cx[k] = contractNet(bu, p.x, k * 4);
+		cy[k] = contractNet(bu, p.y, k * 4);
+		cz[k] = contractNet(bu, p.z, k * 4);
+		dx[k] = contractNet(dbu, p.x, k * 4);
+		dy[k] = contractNet(dbu, p.y, k * 4);
+		dz[k] = contractNet(dbu, p.z, k * 4);
+	}
+
+	contract(bv, cx).store(out.px + i);
+	contract(bv, cy).store(out.py + i);
+	contract(bv, cz).store(out.pz + i);
+	contract(bv, dx).store(out.dux + i);
+	contract(bv, dy).store(out.duy + i);
+	contract(bv, dz).store(out.duz + i);
+	contract(dbv, cx).store(out.dvx + i);
+	contract(dbv, cy).store(out.dvy + i);
+	contract(dbv, cz).store(out.dvz + i);
+}
+
+// Evaluates whole lanes of [begin, end) and returns the first sample left
+// over for a narrower lane type
+template <class V>
+inline int evaluateRange(const PatchSoA& p, const float* u, const float* v,
+	const PatchBatch& out, int begin, int end) {
+	int i = begin;
+	for (; i + V::width <= end; i += V::width) {
+		evaluateLanes<V>(p, u, v, out, i);
+	}
+	return i;
+}
+
+}
+
+// Defined in PatchSimdAvx2.cpp; returns the first sample not evaluated
+int evaluatePatchRangeAvx2(const PatchSoA& patch, const float* u, const float* v,
+	const PatchBatch& out, int begin, int end);
+
+#endif
@@ -0,0 +1,339 @@
+#include "Profile.h"
+#include "Bezier.h"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//****************************************************
+// Global Variables
+//****************************************************
+std::atomic<bool> profiling(false);
+
+thread_local ThreadCounters* threadCounters = NULL;
+
+namespace {
+
+// Counter slots are claimed once per thread and given back when it exits,
+// keeping their counts so totals never drop; threads beyond the last slot
+// share it, which can lose a few of their counts
+const int maxProfileThreads = 256;
+ThreadCounters counterSlots[maxProfileThreads];
+std::atomic<int> slotsClaimed(0);
+std::mutex freeSlotMutex;
+std::vector<int> freeSlots;
+
+// Gives the thread's slot back when the thread exits
+class SlotRelease {
+public:
+	SlotRelease() : slot(-1) {}
+	~SlotRelease() {
+		if (slot < 0) {
+			return;
+		}
+		// Anything counted later in the thread's exit goes to the shared slot
+		threadCounters = &counterSlots[maxProfileThreads - 1];
+		std::lock_guard<std::mutex> lock(freeSlotMutex);
+		freeSlots.push_back(slot);
+	}
+
+	int slot;
+};
+
+thread_local SlotRelease slotRelease;
+
+// At most this many timer spans and frames are kept for writeProfile(), so
+// leaving profiling on doesn't grow without bound
+const size_t maxSpans = 1 << 20;
+const size_t maxFrames = 100000;
+
+class TimerSpan {
+public:
+	const char* name;
+	double start, duration;
+	int thread;
+};
+
+std::mutex spanMutex;
+std::vector<TimerSpan> spans;
+size_t frameFirstSpan = 0;
+
+double origin = currentTime();		// time 0 of the dumps
+double frameStart = 0.0;
+unsigned long long frameCounters[COUNTER_COUNT];
+bool frameOpen = false;
+
+std::vector<FrameProfile> frames;
+FrameProfile lastFrame;
+
+const char* counterNames[COUNTER_DEPTH] = {
+	"patch_evaluations", "triangles_tessellated", "triangles_drawn", "allocations", "allocated_bytes"
+};
+
+double profileTime() {
+	return currentTime() - origin;
+}
+
+void sumCounters(unsigned long long* out) {
+	int slots = std::min(slotsClaimed.load(), maxProfileThreads);
+	std::fill(out, out + COUNTER_COUNT, 0ull);
+	for (int t = 0; t < slots; t++) {
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			out[c] += counterSlots[t].values[c].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+int threadIndex() {
+	ThreadCounters* counters = threadCounters ? threadCounters : registerProfileThread();
+	return counters - counterSlots;
+}
+
+bool endsWith(const std::string& s, const char* suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+}
+
+const char* counterName(int counter) {
+	static char depthNames[profileDepthBins][24];	// fits "depth_" and any int
+	if (counter < COUNTER_DEPTH) {
+		return counterNames[counter];
+	}
+	char* name = depthNames[counter - COUNTER_DEPTH];
+	if (!name[0]) {
+		snprintf(name, sizeof(depthNames[0]), "depth_%d", counter - COUNTER_DEPTH);
+	}
+	return name;
+}
+
+ThreadCounters* registerProfileThread() {
+	int slot = -1;
+	{
+		std::lock_guard<std::mutex> lock(freeSlotMutex);
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+	}
+	if (slot < 0) {
+		slot = slotsClaimed.fetch_add(1);
+		if (slot >= maxProfileThreads - 1) {
+			threadCounters = &counterSlots[maxProfileThreads - 1];
+			return threadCounters;
+		}
+	}
+	slotRelease.slot = slot;
+	threadCounters = &counterSlots[slot];
+	return threadCounters;
+}
+
+//****************************************************
+// Timers
+//****************************************************
+
+ScopedTimer::ScopedTimer(const char* name)
+	: name(name), start(profiling.load(std::memory_order_relaxed) ? profileTime() : -1.0) {}
+
+ScopedTimer::~ScopedTimer() {
+	if (start < 0.0) {
+		return;
+	}
+	TimerSpan span;
+	span.name = name;
+	span.start = start;
+	span.duration = profileTime() - start;
+	span.thread = threadIndex();
+
+	std::lock_guard<std::mutex> lock(spanMutex);
+	if (spans.size() < maxSpans) {
+		spans.push_back(span);
+	}
+}
+
+//****************************************************
+// Frames
+//****************************************************
+
+void beginProfileFrame() {
+	if (!profiling) {
+		return;
+	}
+	frameStart = profileTime();
+	sumCounters(frameCounters);
+	std::lock_guard<std::mutex> lock(spanMutex);
+	frameFirstSpan = spans.size();
+	frameOpen = true;
+}
+
+void endProfileFrame() {
+	if (!profiling || !frameOpen) {
+		return;
+	}
+	frameOpen = false;
+
+	FrameProfile frame;
+	frame.start = frameStart;
+	frame.duration = profileTime() - frameStart;
+	sumCounters(frame.counters);
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		frame.counters[c] -= frameCounters[c];
+	}
+	{
+		std::lock_guard<std::mutex> lock(spanMutex);
+		for (size_t s = frameFirstSpan; s < spans.size(); s++) {
+			size_t t = 0;
+			while (t < frame.timers.size() && strcmp(frame.timers[t].first, spans[s].name) != 0) {
+				t++;
+			}
+			if (t == frame.timers.size()) {
+				frame.timers.push_back(std::make_pair(spans[s].name, 0.0));
+			}
+			frame.timers[t].second += spans[s].duration;
+		}
+	}
+
+	lastFrame = frame;
+	if (frames.size() < maxFrames) {
+		frames.push_back(frame);
+	}
+}
+
+const std::vector<FrameProfile>& profileFrames() {
+	return frames;
+}
+
+const FrameProfile& lastProfileFrame() {
+	return lastFrame;
+}
+
+//****************************************************
+// Dumps
+//****************************************************
+
+static bool writeTrace(FILE* out) {
+	fprintf(out, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t s = 0; s < spans.size(); s++) {
+		const TimerSpan& span = spans[s];
+		fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", span.name, span.thread, span.start * 1e6, span.duration * 1e6);
+		first = false;
+	}
+	for (size_t f = 0; f < frames.size(); f++) {
+		const FrameProfile& frame = frames[f];
+		fprintf(out, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", frame.start * 1e6, frame.duration * 1e6);
+		first = false;
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+				counterName(c), frame.start * 1e6, frame.counters[c]);
+		}
+	}
+	fprintf(out, "\n]}\n");
+	return !ferror(out);
+}
+
+static bool writeCsv(FILE* out) {
+	std::vector<const char*> timers;
+	for (size_t f = 0; f < frames.size(); f++) {
+		for (size_t t = 0; t < frames[f].timers.size(); t++) {
+			const char* name = frames[f].timers[t].first;
+			size_t k = 0;
+			while (k < timers.size() && strcmp(timers[k], name) != 0) {
+				k++;
+			}
+			if (k == timers.size()) {
+				timers.push_back(name);
+			}
+		}
+	}
+
+	fprintf(out, "frame,start_ms,frame_ms");
+	for (size_t t = 0; t < timers.size(); t++) {
+		fprintf(out, ",%s_ms", timers[t]);
+	}
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		fprintf(out, ",%s", counterName(c));
+	}
+	fprintf(out, "\n");
+
+	for (size_t f = 0; f < frames.size(); f++) {
+		const FrameProfile& frame = frames[f];
+		fprintf(out, "%zu,%.3f,%.3f", f, frame.start * 1000.0, frame.duration * 1000.0);
+		for (size_t t = 0; t < timers.size(); t++) {
+			double seconds = 0.0;
+			for (size_t k = 0; k < frame.timers.size(); k++) {
+				if (strcmp(frame.timers[k].first, timers[t]) == 0) {
+					seconds = frame.timers[k].second;
+				}
+			}
+			fprintf(out, ",%.3f", seconds * 1000.0);
+		}
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			fprintf(out, ",%llu", frame.counters[c]);
+		}
+		fprintf(out, "\n");
+	}
+	return !ferror(out);
+}
+
+bool writeProfile(const std::string& file) {
+	FILE* out = fopen(file.c_str(), "w");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	bool ok;
+	{
+		std::lock_guard<std::mutex> lock(spanMutex);
+		ok = endsWith(file, ".json") ? writeTrace(out) : writeCsv(out);
+	}
+	if (fclose(out) != 0 || !ok) {
+		std::cerr << "Error writing " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//****************************************************
+// Allocation counting
+//
+// The replacement operators only count; memory still comes from malloc(),
+// as it does for the standard ones
+//****************************************************
+
+void* operator new(size_t size) {
+	countEvent(COUNTER_ALLOCATIONS);
+	countEvent(COUNTER_ALLOCATED_BYTES, size);
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
@@ -0,0 +1,94 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+//****************************************************
+// Built-in profiling
+//
+// While profiling is on, scoped timers record how long each phase takes on
+// the thread that runs it, and counters count work (patch evaluations,
+// triangles, heap allocations). Counters live per thread, so counting from
+// the tessellation workers costs no synchronization; they are summed when
+// a frame ends. The headless tools treat a whole run as one frame.
+//****************************************************
+
+// Toggled by the UI thread while workers read it
+extern std::atomic<bool> profiling;
+
+// Adaptive triangles are counted by subdivision depth; the last bin also
+// holds everything deeper
+const int profileDepthBins = 16;
+
+enum ProfileCounter {
+	COUNTER_PATCH_EVALUATIONS,		// surface points, from patchPoint() or any traversal
+	COUNTER_TRIANGLES_TESSELLATED,
+	COUNTER_TRIANGLES_DRAWN,
+	COUNTER_ALLOCATIONS,			// operator new calls
+	COUNTER_ALLOCATED_BYTES,
+	COUNTER_DEPTH,					// first of profileDepthBins depth bins
+	COUNTER_COUNT = COUNTER_DEPTH + profileDepthBins
+};
+
+// Column name of a counter in the dumps
+const char* counterName(int counter);
+
+// One thread's counters; only their own thread writes them. A thread gives
+// its slot back when it exits, counts and all, for the next new thread.
+class ThreadCounters {
+public:
+	std::atomic<unsigned long long> values[COUNTER_COUNT];
+};
+
+extern thread_local ThreadCounters* threadCounters;
+ThreadCounters* registerProfileThread();
+
+inline void countEvent(int counter, unsigned long long amount = 1) {
+	if (profiling.load(std::memory_order_relaxed)) {
+		ThreadCounters* counters = threadCounters ? threadCounters : registerProfileThread();
+		std::atomic<unsigned long long>& value = counters->values[counter];
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+}
+
+// Times the enclosing scope under name, which must be a string literal
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* name);
+	~ScopedTimer();
+
+private:
+	const char* name;
+	double start;
+};
+
+// Totals for one frame
+class FrameProfile {
+public:
+	FrameProfile() : start(0.0), duration(0.0) {
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			counters[c] = 0;
+		}
+	}
+
+	double start, duration;		// seconds since the program started
+	std::vector<std::pair<const char*, double> > timers;	// seconds per timer name
+	unsigned long long counters[COUNTER_COUNT];
+};
+
+void beginProfileFrame();
+void endProfileFrame();
+
+// Frames ended so far, oldest first (up to a limit), and the latest one
+const std::vector<FrameProfile>& profileFrames();
+const FrameProfile& lastProfileFrame();
+
+// Writes every frame so far: a Chrome trace (chrome://tracing, Perfetto)
+// of all timer spans and per-frame counters if file ends in .json, and
+// otherwise a CSV with one row per frame. Returns false (after printing
+// why) if the file can't be written.
+bool writeProfile(const std::string& file);
+
+#endif
@@ -0,0 +1,471 @@
+#include "Scene.h"
+#include "MappedFile.h"
+#include "Tessellator.h"
+#include "Profile.h"
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <charconv>
+#endif
+
+//****************************************************
+// Global Variables
+//****************************************************
+
+// Backs scenePatches when a binary scene is loaded
+static MappedFile sceneMapping;
+
+//****************************************************
+// Text parsing
+//****************************************************
+
+// Numbers are parsed straight into the patch array as 48 floats per patch
+static_assert(sizeof(BPatch) == 48 * sizeof(float), "BPatch must be 48 packed floats");
+
+// Files smaller than this are parsed on the calling thread
+static const size_t parallelParseBytes = 1 << 20;
+
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static inline const char* skipSpace(const char* p, const char* end) {
+	while (p < end && isSpace(*p)) {
+		p++;
+	}
+	return p;
+}
+
+static inline const char* skipToken(const char* p, const char* end) {
+	while (p < end && !isSpace(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// Parses the token [p, end) as a float; false unless all of it is a number
+static inline bool parseFloat(const char* p, const char* end, float& value) {
+	if (p < end && *p == '+') {
+		p++;
+	}
+#if defined(__cpp_lib_to_chars)
+	std::from_chars_result result = std::from_chars(p, end, value);
+	return result.ec == std::errc() && result.ptr == end;
+#else
+	// The mapping isn't NUL-terminated, so strtof needs a copy
+	char token[64];
+	size_t length = end - p;
+	if (length == 0 || length >= sizeof(token)) {
+		return false;
+	}
+	memcpy(token, p, length);
+	token[length] = '\0';
+	char* last;
+	value = strtof(token, &last);
+	return last == token + length;
+#endif
+}
+
+// A piece of the file between two whitespace characters
+class ParseChunk {
+public:
+	const char* begin;
+	const char* end;
+	size_t firstToken;	// index of its first number among all control point numbers
+	size_t tokens;
+	float maxValue;
+	const char* error;	// first malformed token, if any
+};
+
+static void countTokens(ParseChunk& chunk) {
+	size_t tokens = 0;
+	const char* p = skipSpace(chunk.begin, chunk.end);
+	while (p < chunk.end) {
+		p = skipSpace(skipToken(p, chunk.end), chunk.end);
+		tokens++;
+	}
+	chunk.tokens = tokens;
+}
+
+// Stores the chunk's numbers at their place in out, ignoring any past count
+static void parseTokens(ParseChunk& chunk, float* out, size_t count) {
+	size_t token = chunk.firstToken;
+	const char* p = skipSpace(chunk.begin, chunk.end);
+	while (p < chunk.end && token < count) {
+		const char* tokenEnd = skipToken(p, chunk.end);
+		float value;
+		if (!parseFloat(p, tokenEnd, value)) {
+			chunk.error = p;
+			return;
+		}
+		out[token++] = value;
+		if (value > chunk.maxValue) {
+			chunk.maxValue = value;
+		}
+		p = skipSpace(tokenEnd, chunk.end);
+	}
+}
+
+// Whether a parsed header is a whole number of patches. The range is checked
+// first, since casting a float beyond int's range is undefined.
+static bool isPatchCount(float value) {
+	return value >= 0 && value < (float) INT_MAX && value == (int) value;
+}
+
+static void reportError(const std::string& file, const char* text, const char* at, const char* end) {
+	size_t line = 1 + std::count(text, at, '\n');
+	std::cerr << file << ":" << line << ": expected a number but found \""
+		<< std::string(at, skipToken(at, end)) << "\"" << std::endl;
+}
+
+static bool parseTextScene(const std::string& file, const MappedFile& mapping) {
+	const char* text = mapping.data();
+	const char* end = text + mapping.size();
+	const char* p = skipSpace(text, end);
+
+	// Patch count
+	int count = 0;
+	if (p < end) {
+		const char* tokenEnd = skipToken(p, end);
+		float value;
+		if (!parseFloat(p, tokenEnd, value) || !isPatchCount(value)) {
+			std::cerr << file << ": expected the patch count but found \""
+				<< std::string(p, tokenEnd) << "\"" << std::endl;
+			return false;
+		}
+		count = (int) value;
+		p = tokenEnd;
+	}
+
+	// Cut the rest into chunks at whitespace, one per task
+	std::vector<ParseChunk> chunks;
+	size_t bytes = end - p;
+	size_t pieces = 1;
+	if (tessellationPool && tessellationPool->size() > 1 && bytes >= parallelParseBytes) {
+		pieces = tessellationPool->size() * 4;
+	}
+	const char* chunkBegin = p;
+	for (size_t i = 0; i < pieces && chunkBegin < end; i++) {
+		const char* chunkEnd = (i + 1 == pieces) ? end : std::max(chunkBegin, p + bytes * (i + 1) / pieces);
+		chunkEnd = skipToken(chunkEnd, end);
+		ParseChunk chunk;
+		chunk.begin = chunkBegin;
+		chunk.end = chunkEnd;
+		chunk.firstToken = 0;
+		chunk.tokens = 0;
+		chunk.maxValue = 0.0;
+		chunk.error = NULL;
+		chunks.push_back(chunk);
+		chunkBegin = chunkEnd;
+	}
+
+	// Count every chunk's numbers to find where each one's first number
+	// lands in the patch array, then parse them all straight into place.
+	// The array is allocated only once the file is known to fill it, so a
+	// bad count is an error rather than a huge allocation.
+	size_t values = (size_t) count * 48;
+
+	if (chunks.size() > 1) {
+		tessellationPool->parallelFor(chunks.size(), [&](int task, int) {
+			countTokens(chunks[task]);
+		});
+	} else if (!chunks.empty()) {
+		countTokens(chunks[0]);
+	}
+
+	size_t tokens = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		chunks[i].firstToken = tokens;
+		tokens += chunks[i].tokens;
+	}
+	if (tokens < values) {
+		std::cerr << file << ": expected " << count << " patches (" << values
+			<< " numbers) but found " << tokens << " numbers" << std::endl;
+		return false;
+	}
+
+	std::vector<BPatch> patches(count);
+	float* out = count > 0 ? &patches[0].c1.p1.x : NULL;
+	if (chunks.size() > 1) {
+		tessellationPool->parallelFor(chunks.size(), [&](int task, int) {
+			parseTokens(chunks[task], out, values);
+		});
+	} else if (!chunks.empty()) {
+		parseTokens(chunks[0], out, values);
+	}
+
+	float maxBoundaries = 0.0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		if (chunks[i].error) {
+			reportError(file, text, chunks[i].error, end);
+			return false;
+		}
+		maxBoundaries = std::max(maxBoundaries, chunks[i].maxValue);
+	}
+
+	bPatches.swap(patches);
+	sceneMapping.close();
+	scenePatches = bPatches.empty() ? NULL : &bPatches[0];
+	numPatches = count;
+	sceneExtent = maxBoundaries;
+	sceneGeneration++;
+	return true;
+}
+
+//****************************************************
+// Binary scenes
+//****************************************************
+
+// A binary scene is this header followed by numPatches control nets of 48
+// floats in BPatch order, starting at headerSize. The header is padded to
+// 64 bytes, so in a mapping every net starts on a 64-byte boundary.
+class BinarySceneHeader {
+public:
+	char magic[4];			// "BZB1"
+	uint32_t byteOrder;		// binarySceneByteOrder as the writer saw it
+	uint32_t headerSize;
+	uint32_t patchSize;		// sizeof(BPatch)
+	uint64_t patchCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float extent;			// largest coordinate, loaded as sceneExtent
+	char reserved[12];
+};
+
+static_assert(sizeof(BinarySceneHeader) == 64, "BinarySceneHeader must be 64 bytes");
+
+static const char binarySceneMagic[4] = { 'B', 'Z', 'B', '1' };
+static const uint32_t binarySceneByteOrder = 0x01020304;
+
+static bool isBinaryScene(const MappedFile& mapping) {
+	return mapping.size() >= sizeof(binarySceneMagic)
+		&& memcmp(mapping.data(), binarySceneMagic, sizeof(binarySceneMagic)) == 0;
+}
+
+// Points scenePatches into the mapping itself; nothing is copied
+static bool loadBinaryScene(const std::string& file, MappedFile& mapping) {
+	BinarySceneHeader header;
+	if (mapping.size() < sizeof(header)) {
+		std::cerr << file << ": truncated header" << std::endl;
+		return false;
+	}
+	memcpy(&header, mapping.data(), sizeof(header));
+	if (header.byteOrder != binarySceneByteOrder) {
+		std::cerr << file << ": written with the other byte order" << std::endl;
+		return false;
+	}
+	if (header.patchSize != sizeof(BPatch) || header.headerSize < sizeof(header)
+		|| header.headerSize % sizeof(float) != 0) {
+		std::cerr << file << ": unsupported layout" << std::endl;
+		return false;
+	}
+	if (header.patchCount > (uint64_t) INT_MAX) {
+		std::cerr << file << ": too many patches" << std::endl;
+		return false;
+	}
+	if (header.headerSize > mapping.size()
+		|| header.patchCount > (uint64_t) ((mapping.size() - header.headerSize) / sizeof(BPatch))) {
+		std::cerr << file << ": expected " << header.patchCount << " patches but the file is "
+			<< mapping.size() << " bytes" << std::endl;
+		return false;
+	}
+
+	sceneMapping.swap(mapping);
+	std::vector<BPatch>().swap(bPatches);
+	scenePatches = (const BPatch*) (sceneMapping.data() + header.headerSize);
+	numPatches = (int) header.patchCount;
+	sceneExtent = header.extent;
+	sceneGeneration++;
+	return true;
+}
+
+bool writeBinaryScene(const std::string& file) {
+	BinarySceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, binarySceneMagic, sizeof(binarySceneMagic));
+	header.byteOrder = binarySceneByteOrder;
+	header.headerSize = sizeof(header);
+	header.patchSize = sizeof(BPatch);
+	header.patchCount = numPatches;
+	header.extent = sceneExtent;
+
+	const float* values = (const float*) scenePatches;
+	for (int k = 0; k < 3; k++) {
+		header.boundsMin[k] = numPatches > 0 ? values[k] : 0.0f;
+		header.boundsMax[k] = header.boundsMin[k];
+	}
+	for (size_t i = 0; i < (size_t) numPatches * 16; i++) {
+		for (int k = 0; k < 3; k++) {
+			header.boundsMin[k] = std::min(header.boundsMin[k], values[i * 3 + k]);
+			header.boundsMax[k] = std::max(header.boundsMax[k], values[i * 3 + k]);
+		}
+	}
+
+	FILE* out = fopen(file.c_str(), "wb");
+	if (!out) {
+		std::cerr << "Unable to write " << file << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+	if (ok && numPatches > 0) {
+		ok = fwrite(scenePatches, sizeof(BPatch), numPatches, out) == (size_t) numPatches;
+	}
+	if (fclose(out) != 0 || !ok) {
+		std::cerr << "Error writing " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//****************************************************
+// Loading
+//****************************************************
+bool loadScene(const std::string& file) {
+	ScopedTimer timer("parse");
+	MappedFile mapping;
+	if (!mapping.open(file)) {
+		std::cerr << "Unable to open file " << file << std::endl;
+		return false;
+	}
+	if (isBinaryScene(mapping)) {
+		return loadBinaryScene(file, mapping);
+	}
+	return parseTextScene(file, mapping);
+}
+
+//****************************************************
+// Streaming
+//****************************************************
+
+// Bigger than any sensible number, and a token must fit in the buffer
+static const size_t readerBufferBytes = 1 << 20;
+
+BezReader::BezReader() : in(NULL), begin(0), end(0), atEnd(false), count(0), patchesRead(0), error(false) {}
+
+BezReader::~BezReader() {
+	if (in) {
+		fclose(in);
+	}
+}
+
+// Finds the next whitespace-separated token, refilling the buffer as needed.
+// The token stays valid until the next call.
+bool BezReader::nextToken(const char*& token, const char*& tokenEnd) {
+	for (;;) {
+		char* data = &buffer[0];
+		const char* p = skipSpace(data + begin, data + end);
+		const char* q = skipToken(p, data + end);
+		// A token running into the end of the buffer may continue in the file
+		bool complete = q < data + end || (atEnd && p < q) || q - p == (ptrdiff_t) buffer.size();
+		if (complete) {
+			token = p;
+			tokenEnd = q;
+			begin = q - data;
+			return true;
+		}
+		if (atEnd) {
+			return false;
+		}
+
+		// Move the partial token to the front and read more after it
+		size_t keep = (data + end) - p;
+		memmove(data, p, keep);
+		size_t got = fread(data + keep, 1, buffer.size() - keep, in);
+		begin = 0;
+		end = keep + got;
+		atEnd = got == 0;
+	}
+}
+
+bool BezReader::open(const std::string& name) {
+	file = name;
+	in = fopen(file.c_str(), "rb");
+	if (!in) {
+		std::cerr << "Unable to open file " << file << std::endl;
+		return false;
+	}
+	buffer.resize(readerBufferBytes);
+
+	const char* token;
+	const char* tokenEnd;
+	if (!nextToken(token, tokenEnd)) {
+		count = 0;
+		return true;
+	}
+	float value;
+	if (!parseFloat(token, tokenEnd, value) || !isPatchCount(value)) {
+		std::cerr << file << ": expected the patch count but found \""
+			<< std::string(token, tokenEnd) << "\"" << std::endl;
+		error = true;
+		return false;
+	}
+	count = (int) value;
+	return true;
+}
+
+size_t BezReader::read(BPatch* out, size_t max) {
+	size_t patches = 0;
+	while (patches < max && patchesRead < count && !error) {
+		float* values = &out[patches].c1.p1.x;
+		for (int i = 0; i < 48; i++) {
+			const char* token;
+			const char* tokenEnd;
+			if (!nextToken(token, tokenEnd)) {
+				std::cerr << file << ": expected " << count << " patches but found "
+					<< patchesRead << std::endl;
+				error = true;
+				return 0;
+			}
+			if (!parseFloat(token, tokenEnd, values[i])) {
+				std::cerr << file << ": expected a number in patch " << patchesRead
+					<< " but found \"" << std::string(token, tokenEnd) << "\"" << std::endl;
+				error = true;
+				return 0;
+			}
+		}
+		patches++;
+		patchesRead++;
+	}
+	return patches;
+}
+
+//****************************************************
+// Background loading
+//****************************************************
+static std::thread loadThread;
+static bool loadResult = false;
+
+static void joinLoadThread() {
+	if (loadThread.joinable()) {
+		loadThread.join();
+	}
+}
+
+// Registered with atexit(), so exiting before finishSceneLoad() (GLUT exits
+// when it can't open a display) waits for the parse instead of destroying
+// a joinable thread
+void startSceneLoad(const std::string& file) {
+	static bool registered = false;
+	if (!registered) {
+		atexit(joinLoadThread);
+		registered = true;
+	}
+	loadThread = std::thread([file]() {
+		loadResult = loadScene(file);
+	});
+}
+
+bool finishSceneLoad() {
+	joinLoadThread();
+	return loadResult;
+}
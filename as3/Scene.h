@@ -0,0 +1,68 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "Bezier.h"
+
+//****************************************************
+// Scene loading
+//
+// A .bez file is the patch count followed by 4 curves of 4 control points
+// (12 floats) per patch, separated by any whitespace. A binary scene (.bzb,
+// see writeBinaryScene()) holds the same control nets as raw floats.
+//****************************************************
+
+// Replaces the scene (scenePatches, numPatches, sceneExtent) with the
+// patches of file, telling text and binary scenes apart by their first
+// bytes. Large text files are parsed in parallel on tessellationPool when it
+// exists; binary files are mapped and used in place. Returns false (after
+// printing why) if the file can't be read or is malformed.
+bool loadScene(const std::string& file);
+
+// Writes the scene as a binary scene file: a 64-byte header (magic, byte
+// order, patch count, bounds, extent) and then the packed control nets
+bool writeBinaryScene(const std::string& file);
+
+// Reads a .bez file front to back through a fixed-size buffer, for scenes
+// that shouldn't (or can't) be held in memory at once
+class BezReader {
+public:
+	BezReader();
+	~BezReader();
+
+	// Opens file and reads its patch count; false (after printing why) on error
+	bool open(const std::string& file);
+	int patchCount() const { return count; }
+
+	// Reads up to max of the remaining patches into out and returns how many
+	// it read, 0 at the end or on error
+	size_t read(BPatch* out, size_t max);
+	bool failed() const { return error; }
+
+private:
+	BezReader(const BezReader&);
+	BezReader& operator=(const BezReader&);
+
+	bool nextToken(const char*& token, const char*& tokenEnd);
+
+	std::string file;
+	FILE* in;
+	std::vector<char> buffer;
+	size_t begin, end;
+	bool atEnd;
+	int count, patchesRead;
+	bool error;
+};
+
+// Runs loadScene() on a background thread, so the caller can do other setup
+// (creating the window) meanwhile. The scene must not be touched until
+// finishSceneLoad() returns.
+void startSceneLoad(const std::string& file);
+
+// Waits for startSceneLoad() and returns what loadScene() returned
+bool finishSceneLoad();
+
+#endif
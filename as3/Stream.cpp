@@ -0,0 +1,140 @@
+#include "Stream.h"
+#include "Bezier.h"
+#include "Tessellator.h"
+#include "Scene.h"
+#include "MeshIO.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+namespace {
+
+// Blocks in flight per stage hand-off: one being produced, one waiting and
+// one being consumed
+const int streamBlocks = 3;
+
+// Aim for about this many vertices (24 bytes each, plus indices) per block
+const size_t blockVertices = 1 << 18;
+
+// Patches per block when the output size per patch isn't known up front
+const size_t adaptiveBlockPatches = 256;
+
+// Unbounded FIFO; the stages bound it by recycling a fixed set of blocks
+template <class T>
+class BlockQueue {
+public:
+	BlockQueue() : closed(false) {}
+
+	void push(T item) {
+		std::lock_guard<std::mutex> lock(mutex);
+		items.push_back(item);
+		ready.notify_one();
+	}
+
+	// Waits for an item; false once the queue is closed and empty
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [this]() { return !items.empty() || closed; });
+		if (items.empty()) {
+			return false;
+		}
+		item = items.front();
+		items.pop_front();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		ready.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<T> items;
+	bool closed;
+};
+
+class PatchBlock {
+public:
+	std::vector<BPatch> patches;
+	size_t count;
+};
+
+}
+
+bool streamTessellate(const std::string& input, const std::string& output, StreamStats& stats) {
+	BezReader reader;
+	if (!reader.open(input)) {
+		return false;
+	}
+	MeshWriter writer;
+	if (!writer.open(output)) {
+		return false;
+	}
+
+	size_t blockPatches = adaptiveBlockPatches;
+	if (!adaptive) {
+		size_t n = uniformSteps() + 1;
+		blockPatches = std::max<size_t>(1, blockVertices / (n * n));
+	}
+
+	PatchBlock patchBlocks[streamBlocks];
+	Mesh meshBlocks[streamBlocks];
+	BlockQueue<PatchBlock*> freePatches, parsed;
+	BlockQueue<Mesh*> freeMeshes, tessellated;
+	for (int i = 0; i < streamBlocks; i++) {
+		patchBlocks[i].patches.resize(blockPatches);
+		freePatches.push(&patchBlocks[i]);
+		freeMeshes.push(&meshBlocks[i]);
+	}
+
+	std::thread parser([&]() {
+		PatchBlock* block = NULL;
+		while (freePatches.pop(block)) {
+			block->count = reader.read(&block->patches[0], blockPatches);
+			if (block->count == 0) {
+				break;
+			}
+			parsed.push(block);
+		}
+		parsed.close();
+	});
+
+	bool writeOk = true;
+	std::thread writerThread([&]() {
+		Mesh* mesh = NULL;
+		while (tessellated.pop(mesh)) {
+			if (writeOk && !writer.append(*mesh)) {
+				writeOk = false;
+			}
+			freeMeshes.push(mesh);
+		}
+	});
+
+	// Tessellation runs here, on the pool
+	PatchBlock* block = NULL;
+	while (parsed.pop(block)) {
+		Mesh* mesh = NULL;
+		freeMeshes.pop(mesh);
+		tessellatePatches(&block->patches[0], block->count, *mesh);
+		stats.patches += block->count;
+		stats.blocks++;
+		freePatches.push(block);
+		tessellated.push(mesh);
+	}
+	freePatches.close();
+	tessellated.close();
+	parser.join();
+	writerThread.join();
+
+	stats.vertices = writer.vertexCount();
+	stats.triangles = writer.triangleCount();
+	bool closed = writer.close();
+	return !reader.failed() && writeOk && closed;
+}
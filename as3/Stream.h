@@ -0,0 +1,29 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <string>
+#include <cstddef>
+
+//****************************************************
+// Out-of-core tessellation
+//****************************************************
+
+class StreamStats {
+public:
+	size_t patches;
+	size_t vertices;
+	size_t triangles;
+	size_t blocks;
+
+	StreamStats() : patches(0), vertices(0), triangles(0), blocks(0) {}
+};
+
+// Tessellates the .bez file input into the mesh file output (.ply or .obj)
+// without loading either whole. A parser thread, the tessellation pool and a
+// writer thread work on consecutive blocks of patches at once; only a few
+// blocks exist at any time, so memory stays bounded whatever the file size.
+// Uses the current stepSize and mode and needs initTessellator(). Returns
+// false (after printing why) on errors.
+bool streamTessellate(const std::string& input, const std::string& output, StreamStats& stats);
+
+#endif
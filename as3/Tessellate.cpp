@@ -0,0 +1,14 @@
+#include "Batch.h"
+
+//****************************************************
+// Headless tessellator: the viewer's command line without any GL or GLUT,
+// for machines with no display or GL libraries
+//****************************************************
+int main(int argc, char *argv[]) {
+	CommandLine cmd;
+	if (!parseCommandLine(argc, argv, cmd)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	return runBatch(cmd);
+}
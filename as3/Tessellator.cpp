@@ -0,0 +1,343 @@
+#include "Tessellator.h"
+#include "Profile.h"
+#include "Density.h"
+
+#include <algorithm>
+
+//****************************************************
+// Global Variables
+//****************************************************
+bool adaptive = false;
+bool forwardDifferencing = false;
+
+int tessellationThreads = 0;
+ThreadPool* tessellationPool = NULL;
+
+BasisTable basisTable;
+
+unsigned int adaptiveMaxDepth = 0;
+size_t adaptiveMaxTriangles = 0;
+double adaptiveMaxSeconds = 0.0;
+
+bool viewDependent = false;
+AdaptiveView tessellationView;
+
+//****************************************************
+// Parallel tessellation
+//****************************************************
+
+// One unit of work: vertex rows [rowBegin, rowEnd) of a patch (the whole
+// patch in adaptive mode). Its output lands in its worker's buffer and is
+// copied to [outVertex, outIndex) of the final mesh.
+class TessTask {
+public:
+	int patch;
+	unsigned int rowBegin, rowEnd;
+	int worker;
+	size_t vertexBegin, vertexEnd;
+	size_t indexBegin, indexEnd;
+	size_t outVertex, outIndex;
+};
+
+// Per-thread output and scratch, kept between rebuilds so their storage is
+// reused
+class TessWorker {
+public:
+	Mesh mesh;
+	BatchBuffer buffer;
+	AdaptiveScratch scratch;
+};
+
+std::vector<TessTask> tessTasks;
+std::vector<TessWorker> tessWorkers;
+
+// Seed error of each task's patch, for sharing out the adaptive budgets
+std::vector<float> tessWeights;
+
+// Analytic density: cells along u and v of each patch, and the matched
+// sides of the whole scene of generation tessSidesGeneration when
+// tessSidesKept (other patch sets, such as streamed blocks, are matched on
+// every pass)
+std::vector<unsigned int> tessCounts;
+std::vector<int> tessSides;
+bool tessSidesKept = false;
+unsigned int tessSidesGeneration = 0;
+
+// Patches of the current tessellatePatches() call
+const BPatch* tessPatches = NULL;
+size_t tessPatchCount = 0;
+const unsigned char* tessVisible = NULL;
+
+// Splits the visible patches into tasks: one per patch when there are
+// enough patches to keep every thread busy, otherwise each patch's rows are
+// cut into strips
+void planTasks(unsigned int rows){
+	size_t patches = tessPatchCount;
+	if (tessVisible) {
+		patches = std::count_if(tessVisible, tessVisible + tessPatchCount,
+			[](unsigned char v) { return v != 0; });
+	}
+	size_t wanted = tessellationPool->size() * 4;
+	unsigned int strips = 1;
+	if (!adaptive && !analyticDensity && patches > 0 && patches < wanted) {
+		strips = (wanted + patches - 1) / patches;
+		if (strips > rows) {
+			strips = rows;
+		}
+	}
+
+	tessTasks.resize(patches * strips);
+	size_t t = 0;
+	for (size_t i = 0; i < tessPatchCount; i++) {
+		if (tessVisible && !tessVisible[i]) {
+			continue;
+		}
+		for (unsigned int k = 0; k < strips; k++) {
+			TessTask& task = tessTasks[t++];
+			task.patch = i;
+			task.rowBegin = rows * k / strips;
+			task.rowEnd = rows * (k + 1) / strips;
+		}
+	}
+}
+
+void uniformTesselation(){
+	updateBasisTable(basisTable);
+	unsigned int n = basisTable.samples.size();
+	planTasks(n);
+
+	std::vector<float> gridU, gridV;
+	if (simdEvaluation) {
+		for (unsigned int i = 0; i < n; i++) {
+			for (unsigned int j = 0; j < n; j++) {
+				gridU.push_back(basisTable.samples[i]);
+				gridV.push_back(basisTable.samples[j]);
+			}
+		}
+		for (size_t w = 0; w < tessWorkers.size(); w++) {
+			tessWorkers[w].buffer.resize(n * n);
+		}
+	}
+
+	tessellationPool->parallelFor(tessTasks.size(), [&](int t, int w) {
+		TessTask& task = tessTasks[t];
+		TessWorker& worker = tessWorkers[w];
+		const BPatch& patch = tessPatches[task.patch];
+
+		task.worker = w;
+		task.vertexBegin = worker.mesh.vertices.size();
+		task.indexBegin = worker.mesh.indices.size();
+		if (simdEvaluation) {
+			simdTraversal(patch, gridU, gridV, n, task.rowBegin, task.rowEnd,
+				worker.buffer, worker.mesh);
+		} else if (forwardDifferencing) {
+			forwardTraversal(patch, n - 1, task.rowBegin, task.rowEnd, worker.mesh);
+		} else {
+			curveTraversal(patch, basisTable, task.rowBegin, task.rowEnd, worker.mesh);
+		}
+		task.vertexEnd = worker.mesh.vertices.size();
+		task.indexEnd = worker.mesh.indices.size();
+	});
+}
+
+void adaptiveTriangulation() {
+	planTasks(1);
+
+	// Patches that start out further from flat get a larger share of the
+	// triangle and time budgets. The time shares add up to the pass budget
+	// on every thread, and the pass deadline caps them all.
+	const AdaptiveView* view = viewDependent ? &tessellationView : NULL;
+	bool budgeted = adaptiveMaxTriangles > 0 || adaptiveMaxSeconds > 0.0;
+	double passStart = currentTime();
+	double passDeadline = passStart + adaptiveMaxSeconds;
+	double threadSeconds = adaptiveMaxSeconds * tessellationPool->size();
+	double totalWeight = 0.0;
+	if (budgeted) {
+		tessWeights.resize(tessTasks.size());
+		tessellationPool->parallelFor(tessTasks.size(), [&](int t, int) {
+			tessWeights[t] = adaptiveSeedError(tessPatches[tessTasks[t].patch], view) + 1.0f;
+		});
+		for (size_t t = 0; t < tessTasks.size(); t++) {
+			totalWeight += tessWeights[t];
+		}
+	}
+
+	// Patch sides answer only to limits every patch shares, so neighbours
+	// split them alike: the depth limit, the pass deadline, and the depth at
+	// which the sides take at most a quarter of the triangle budget and half
+	// of the time budget. A patch whose sides are all at depth d has 4 * 2^d
+	// side segments, each with a triangle or two; the seed pass timed the
+	// five edge tests of each patch, and a side segment costs about three.
+	unsigned int sideDepth = adaptiveGridBits;
+	if (adaptiveMaxDepth > 0) {
+		sideDepth = std::min(sideDepth, adaptiveMaxDepth);
+	}
+	size_t patches = tessTasks.size();
+	size_t sideSegments = 0;
+	if (adaptiveMaxTriangles > 0) {
+		sideSegments = adaptiveMaxTriangles / 4;
+	}
+	if (adaptiveMaxSeconds > 0.0 && patches > 0) {
+		double seedSeconds = std::max(currentTime() - passStart, 1e-6) * tessellationPool->size();
+		double segmentSeconds = 3.0 * seedSeconds / (5.0 * patches);
+		size_t affordable = (size_t) (threadSeconds / 2.0 / segmentSeconds);
+		sideSegments = sideSegments > 0 ? std::min(sideSegments, affordable) : affordable;
+	}
+	if (budgeted) {
+		unsigned int depth = 0;
+		while (depth < sideDepth && (patches * 4 << (depth + 1)) <= sideSegments) {
+			depth++;
+		}
+		sideDepth = depth;
+	}
+
+	// Every patch gets its two seed triangles, and keeps room for the side
+	// segments it may still have to split once its own budget has run out,
+	// so the pass stays within adaptiveMaxTriangles when that allows two
+	// triangles per patch
+	size_t sharedTriangles = 0;
+	if (adaptiveMaxTriangles > 0) {
+		size_t reserved = patches * (2 + (4 << sideDepth) - 4);
+		sharedTriangles = adaptiveMaxTriangles - std::min(reserved, adaptiveMaxTriangles);
+	}
+
+	tessellationPool->parallelFor(tessTasks.size(), [&](int t, int w) {
+		TessTask& task = tessTasks[t];
+		TessWorker& worker = tessWorkers[w];
+
+		AdaptiveLimits limits;
+		limits.maxDepth = adaptiveMaxDepth;
+		limits.maxSideDepth = sideDepth;
+		if (budgeted) {
+			double share = tessWeights[t] / totalWeight;
+			if (adaptiveMaxTriangles > 0) {
+				limits.maxTriangles = 2 + (size_t) (sharedTriangles * share);
+			}
+			if (adaptiveMaxSeconds > 0.0) {
+				limits.deadline = std::min(passDeadline, currentTime() + threadSeconds * share);
+				limits.sideDeadline = passDeadline;
+			}
+		}
+
+		task.worker = w;
+		task.vertexBegin = worker.mesh.vertices.size();
+		task.indexBegin = worker.mesh.indices.size();
+		adaptiveTraversal(tessPatches[task.patch], worker.scratch, worker.mesh, limits, view);
+		task.vertexEnd = worker.mesh.vertices.size();
+		task.indexEnd = worker.mesh.indices.size();
+	});
+}
+
+// Every patch's grid counts come from its own control net; every side
+// takes the larger count of the two patches sharing it, so both sample it
+// alike. Side matching depends only on the patches, so it is kept for the
+// next pass over the same scene; a scene load or a pass over other patches
+// (whose buffer may be refilled in place) matches them again.
+void analyticTessellation() {
+	planTasks(1);
+
+	tessCounts.resize(tessPatchCount * 2);
+	tessellationPool->parallelFor(tessPatchCount, [&](int i, int) {
+		analyticCounts(tessPatches[i], stepSize, &tessCounts[i * 2]);
+	});
+	bool wholeScene = tessPatches == scenePatches && tessPatchCount == (size_t) numPatches;
+	if (!wholeScene || !tessSidesKept || tessSidesGeneration != sceneGeneration) {
+		matchPatchSides(tessPatches, tessPatchCount, tessSides);
+		tessSidesKept = wholeScene;
+		tessSidesGeneration = sceneGeneration;
+	}
+
+	tessellationPool->parallelFor(tessTasks.size(), [&](int t, int w) {
+		TessTask& task = tessTasks[t];
+		TessWorker& worker = tessWorkers[w];
+
+		// Sides 0 and 2 run along u, 1 and 3 along v
+		const unsigned int* counts = &tessCounts[task.patch * 2];
+		unsigned int edges[4];
+		for (int side = 0; side < 4; side++) {
+			edges[side] = counts[side % 2];
+			int other = tessSides[task.patch * 4 + side];
+			if (other >= 0) {
+				edges[side] = std::max(edges[side], tessCounts[other / 4 * 2 + other % 2]);
+			}
+		}
+
+		task.worker = w;
+		task.vertexBegin = worker.mesh.vertices.size();
+		task.indexBegin = worker.mesh.indices.size();
+		densityTraversal(tessPatches[task.patch], counts, edges, worker.mesh);
+		task.vertexEnd = worker.mesh.vertices.size();
+		task.indexEnd = worker.mesh.indices.size();
+	});
+}
+
+// Concatenates the task outputs in task order, so the mesh layout is the same
+// for any thread count
+void spliceTasks(Mesh& mesh){
+	size_t vertices = 0, indices = 0;
+	for (size_t t = 0; t < tessTasks.size(); t++) {
+		tessTasks[t].outVertex = vertices;
+		tessTasks[t].outIndex = indices;
+		vertices += tessTasks[t].vertexEnd - tessTasks[t].vertexBegin;
+		indices += tessTasks[t].indexEnd - tessTasks[t].indexBegin;
+	}
+	mesh.vertices.resize(vertices);
+	mesh.indices.resize(indices);
+
+	// Tasks are in patch order, so each patch starts at its first task
+	mesh.patchStarts.resize(tessPatchCount + 1);
+	size_t next = 0;
+	for (size_t i = 0; i <= tessPatchCount; i++) {
+		while (next < tessTasks.size() && (size_t) tessTasks[next].patch < i) {
+			next++;
+		}
+		mesh.patchStarts[i] = next < tessTasks.size() ? tessTasks[next].outIndex : indices;
+	}
+
+	tessellationPool->parallelFor(tessTasks.size(), [&](int t, int) {
+		const TessTask& task = tessTasks[t];
+		const Mesh& source = tessWorkers[task.worker].mesh;
+
+		std::copy(source.vertices.begin() + task.vertexBegin,
+			source.vertices.begin() + task.vertexEnd,
+			mesh.vertices.begin() + task.outVertex);
+
+		unsigned int offset = task.outVertex - task.vertexBegin;
+		for (size_t i = task.indexBegin; i < task.indexEnd; i++) {
+			mesh.indices[task.outIndex + i - task.indexBegin] = source.indices[i] + offset;
+		}
+	});
+}
+
+void tessellatePatches(const BPatch* patches, size_t count, Mesh& mesh,
+	const unsigned char* visible){
+	ScopedTimer timer("tessellate");
+	tessPatches = patches;
+	tessPatchCount = count;
+	tessVisible = visible;
+	tessWorkers.resize(tessellationPool->size());
+	for (size_t w = 0; w < tessWorkers.size(); w++) {
+		tessWorkers[w].mesh.clear();
+	}
+
+	if (adaptive) {
+		adaptiveTriangulation();
+	} else if (analyticDensity) {
+		analyticTessellation();
+	} else {
+		uniformTesselation();
+	}
+	spliceTasks(mesh);
+	countEvent(COUNTER_TRIANGLES_TESSELLATED, mesh.indices.size() / 3);
+}
+
+void tessellate(Mesh& mesh, const unsigned char* visible){
+	tessellatePatches(scenePatches, numPatches, mesh, visible);
+}
+
+void initTessellator(){
+	if (tessellationThreads <= 0) {
+		tessellationThreads = ThreadPool::hardwareThreads();
+	}
+	tessellationPool = new ThreadPool(tessellationThreads);
+}
@@ -0,0 +1,47 @@
+#ifndef TESSELLATOR_H
+#define TESSELLATOR_H
+
+#include "Bezier.h"
+#include "Adaptive.h"
+#include "ThreadPool.h"
+
+//****************************************************
+// Whole-model tessellation on a thread pool
+//****************************************************
+
+extern bool adaptive;
+
+// Use forward differencing instead of the basis table for uniform mode
+extern bool forwardDifferencing;
+
+// Workers for tessellation; 0 threads means one per hardware thread
+extern int tessellationThreads;
+extern ThreadPool* tessellationPool;
+
+extern BasisTable basisTable;
+
+// Budgets for one adaptive tessellation pass; 0 means unlimited. The
+// triangle and time budgets are shared out between patches by their seed
+// error, and each patch refines its largest errors first within its share.
+extern unsigned int adaptiveMaxDepth;
+extern size_t adaptiveMaxTriangles;
+extern double adaptiveMaxSeconds;
+
+// Adaptive mode measures error in pixels on tessellationView instead of
+// against stepSize; the window keeps the view in step with the camera
+extern bool viewDependent;
+extern AdaptiveView tessellationView;
+
+// Creates tessellationPool from tessellationThreads
+void initTessellator();
+
+// Replaces mesh with the tessellation of patches [0, count), using the
+// current stepSize and mode. If visible is given, only the patches it marks
+// are tessellated.
+void tessellatePatches(const BPatch* patches, size_t count, Mesh& mesh,
+	const unsigned char* visible = NULL);
+
+// tessellatePatches() on the whole scene
+void tessellate(Mesh& mesh, const unsigned char* visible = NULL);
+
+#endif
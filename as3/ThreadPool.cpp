@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threads)
+	: threadCount(threads < 1 ? 1 : threads), job(NULL), jobCount(0), nextTask(0),
+	generation(0), busyWorkers(0), stopping(false) {
+	for (int i = 1; i < threadCount; i++) {
+		this->threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+int ThreadPool::hardwareThreads() {
+	int n = std::thread::hardware_concurrency();
+	return n < 1 ? 1 : n;
+}
+
+void ThreadPool::parallelFor(int count, const Task& task) {
+	if (threads.empty() || count <= 1) {
+		for (int i = 0; i < count; i++) {
+			task(i, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &task;
+		jobCount = count;
+		nextTask = 0;
+		busyWorkers = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	runTasks(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (busyWorkers > 0) {
+		finished.wait(lock);
+	}
+	job = NULL;
+}
+
+void ThreadPool::runTasks(int worker) {
+	for (int i = nextTask++; i < jobCount; i = nextTask++) {
+		(*job)(i, worker);
+	}
+}
+
+void ThreadPool::workerLoop(int worker) {
+	int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && generation == seen) {
+				wake.wait(lock);
+			}
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+
+		runTasks(worker);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0) {
+			finished.notify_one();
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+//****************************************************
+// Fixed-size pool of worker threads running parallel loops. The calling
+// thread takes part as worker 0, so a pool of size 1 runs everything inline.
+//****************************************************
+class ThreadPool {
+public:
+	typedef std::function<void(int task, int worker)> Task;
+
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+
+	int size() const { return threadCount; }
+
+	// Runs task(i, worker) for every i in [0, count) and returns when all are
+	// done. Tasks are handed out in increasing order; worker is in [0, size()).
+	void parallelFor(int count, const Task& task);
+
+	// Number of hardware threads, at least 1
+	static int hardwareThreads();
+
+private:
+	void workerLoop(int worker);
+	void runTasks(int worker);
+
+	int threadCount;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	const Task* job;
+	int jobCount;
+	std::atomic<int> nextTask;
+	int generation;
+	int busyWorkers;
+	bool stopping;
+};
+
+#endif